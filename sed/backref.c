@@ -0,0 +1,366 @@
+/*  GNU SED, a batch stream editor.
+    Copyright (C) 2024 Free Software Foundation, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; If not, see <https://www.gnu.org/licenses/>. */
+
+/* A matcher for the patterns of onepass.c that also have
+   back-references, such as '^\(.*\)\n\1$'.  The DFA cannot match
+   those, and re_search may backtrack a lot on them.  This matcher
+   only finds where the leftmost match starts, which is all that an
+   address needs; for 's', re_search then computes the registers of
+   the match at that position only.
+
+   It is a depth-first search in which each element of the pattern is
+   tried at each position where the previous one can end.  Whether the
+   rest of the pattern matches from element K at position POS only
+   depends on K, POS and the text of the groups that back-references
+   after K refer to.  The triples for which it does not are remembered,
+   so that each one is explored once.  There can still be a quadratic
+   number of them, so the search gives up after a number of steps
+   proportional to the length of the text, and the caller then falls
+   back on re_search.  */
+
+#include "sed.h"
+
+#include <stdckdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "minmax.h"
+#include "xalloc.h"
+
+/* The groups that back-references can refer to, \1 to \9.  */
+#define BACKREF_GROUPS 9
+
+/* The steps that a search may take per byte of text.  */
+#define BACKREF_STEPS_PER_BYTE 8
+
+/* The most bytes that the table of failed triples may take.  Each
+   entry takes more room the more groups there are.  */
+#define BACKREF_MEMO_BYTES (16 * 1024 * 1024)
+
+struct backref_frame {
+  int elt;			/* The element tried.  */
+  idx_t pos;			/* Where it starts.  */
+  idx_t lo, hi;			/* Where it may end, tried from HI down.  */
+};
+
+struct backref {
+  int n_elts;
+  struct simple_elt *elts;
+  idx_t nsub;
+
+  /* Group G starts before element GROUP_OPEN[G], and ends before
+     element GROUP_CLOSE[G] (or at the end if that is N_ELTS).  */
+  int *group_open;
+  int *group_close;
+
+  bool anchor_start;
+  bool anchor_end;
+
+  /* Bit G of LIVE[K] is set if a back-reference at element K or later
+     refers to group G.  */
+  unsigned int *live;
+
+  /* Scratch space for backref_search: the registers of the groups, the
+     frames of the search, and a hash table of the failed triples, each
+     stored as KEY_LEN offsets.  A slot is in use if its MEMO_EPOCH is
+     that of the current search.  */
+  idx_t *caps;
+  struct backref_frame *stack;
+  int key_len;
+  idx_t *memo;
+  intmax_t *memo_epoch;
+  idx_t memo_size;
+  idx_t memo_count;
+  intmax_t epoch;
+};
+
+/* Return a matcher for the normalized pattern RE of length SZ with
+   NSUB groups, or NULL if RE has no back-references or is not in the
+   class described above.  EXTENDED tells whether RE is an ERE.  */
+struct backref *
+backref_compile (const char *re, idx_t sz, bool extended, idx_t nsub)
+{
+  struct backref *br = XZALLOC (struct backref);
+  int k;
+
+  br->elts = XNMALLOC (SIMPLE_REGEX_MAX_ELTS, struct simple_elt);
+  br->group_open = XNMALLOC (nsub + 1, int);
+  br->group_close = XNMALLOC (nsub + 1, int);
+  br->n_elts = simple_regex_parse (re, sz, extended, nsub, true, br->elts,
+                                   br->group_open, br->group_close,
+                                   &br->anchor_start, &br->anchor_end);
+  if (br->n_elts <= 0)
+    goto fail;
+
+  br->live = XNMALLOC (br->n_elts + 1, unsigned int);
+  br->live[br->n_elts] = 0;
+  for (k = br->n_elts - 1; k >= 0; k--)
+    br->live[k] = (br->live[k + 1]
+                   | (br->elts[k].ref ? 1u << (br->elts[k].ref - 1) : 0));
+  if (!br->live[0])
+    goto fail;
+
+  br->elts = xnrealloc (br->elts, br->n_elts, sizeof *br->elts);
+  br->nsub = MIN (nsub, BACKREF_GROUPS);
+  br->key_len = 2 + 2 * br->nsub;
+  br->caps = XNMALLOC (2 * br->nsub, idx_t);
+  br->stack = XNMALLOC (br->n_elts, struct backref_frame);
+  return br;
+
+ fail:
+  backref_free (br);
+  return NULL;
+}
+
+void
+backref_free (struct backref *br)
+{
+  if (!br)
+    return;
+  free (br->elts);
+  free (br->group_open);
+  free (br->group_close);
+  free (br->live);
+  free (br->caps);
+  free (br->stack);
+  free (br->memo);
+  free (br->memo_epoch);
+  free (br);
+}
+
+/* Record the groups that start or end before element K, at POS.  */
+static void
+enter_elt (struct backref *br, int k, idx_t pos)
+{
+  idx_t g;
+
+  for (g = 0; g < br->nsub; g++)
+    {
+      if (br->group_open[g] == k)
+        br->caps[2 * g] = pos;
+      if (br->group_close[g] == k)
+        br->caps[2 * g + 1] = pos;
+    }
+}
+
+/* Store in KEY the triple for element K at POS: the registers of the
+   groups that start or end before K, if back-references after K refer
+   to them.  */
+static void
+memo_key (struct backref *br, idx_t *key, int k, idx_t pos)
+{
+  idx_t g;
+
+  key[0] = k;
+  key[1] = pos;
+  for (g = 0; g < br->nsub; g++)
+    {
+      bool live = br->live[k] & (1u << g);
+      key[2 + 2 * g] = live && br->group_open[g] <= k ? br->caps[2 * g] : -1;
+      key[3 + 2 * g] = (live && br->group_close[g] <= k
+                        ? br->caps[2 * g + 1] : -1);
+    }
+}
+
+/* Return the slot for KEY in the hash table: either the one that holds
+   it, or the free one where it would go.  */
+static idx_t
+memo_slot (struct backref *br, const idx_t *key)
+{
+  size_t h = 0;
+  idx_t slot;
+  int i;
+
+  for (i = 0; i < br->key_len; i++)
+    h = (h ^ key[i]) * 31 + (h >> 17);
+  for (slot = h & (br->memo_size - 1); ;
+       slot = (slot + 1) & (br->memo_size - 1))
+    if (br->memo_epoch[slot] != br->epoch
+        || memcmp (br->memo + slot * br->key_len, key,
+                   br->key_len * sizeof *key) == 0)
+      return slot;
+}
+
+static bool
+memo_find (struct backref *br, const idx_t *key)
+{
+  return (br->memo_count > 0
+          && br->memo_epoch[memo_slot (br, key)] == br->epoch);
+}
+
+/* Remember that the triple KEY fails, if there is room.  */
+static void
+memo_add (struct backref *br, const idx_t *key)
+{
+  idx_t slot;
+
+  if (2 * (br->memo_count + 1) > br->memo_size)
+    {
+      idx_t old_size = br->memo_size, i;
+      idx_t *old_memo = br->memo;
+      intmax_t *old_epoch = br->memo_epoch;
+      idx_t slot_bytes = (br->key_len * sizeof *br->memo
+                          + sizeof *br->memo_epoch);
+
+      if (old_size && BACKREF_MEMO_BYTES / slot_bytes < 2 * old_size)
+        return;
+      br->memo_size = old_size ? 2 * old_size : 64;
+      br->memo = XNMALLOC (br->memo_size * br->key_len, idx_t);
+      br->memo_epoch = xcalloc (br->memo_size, sizeof *br->memo_epoch);
+      for (i = 0; i < old_size; i++)
+        if (old_epoch[i] == br->epoch)
+          {
+            const idx_t *old_key = old_memo + i * br->key_len;
+            slot = memo_slot (br, old_key);
+            memcpy (br->memo + slot * br->key_len, old_key,
+                    br->key_len * sizeof *old_key);
+            br->memo_epoch[slot] = br->epoch;
+          }
+      free (old_memo);
+      free (old_epoch);
+    }
+
+  slot = memo_slot (br, key);
+  memcpy (br->memo + slot * br->key_len, key, br->key_len * sizeof *key);
+  br->memo_epoch[slot] = br->epoch;
+  br->memo_count++;
+}
+
+/* Start trying element K at POS, pushing a frame on the stack of
+   depth *SP unless the triple is known to fail, and charge BUDGET for
+   the bytes examined.  If K is past the last element, return whether
+   the pattern matches up to POS.  */
+static bool
+start_elt (struct backref *br, const char *buf, idx_t buflen,
+           int k, idx_t pos, int *sp, idx_t *budget)
+{
+  idx_t key[2 + 2 * BACKREF_GROUPS];
+  const struct simple_elt *e;
+  struct backref_frame *f;
+
+  --*budget;
+  if (k == br->n_elts)
+    return !br->anchor_end || pos == buflen;
+
+  memo_key (br, key, k, pos);
+  if (memo_find (br, key))
+    return false;
+
+  e = &br->elts[k];
+  f = &br->stack[(*sp)++];
+  f->elt = k;
+  f->pos = pos;
+  if (e->ref)
+    {
+      idx_t s = br->caps[2 * (e->ref - 1)];
+      idx_t len = br->caps[2 * e->ref - 1] - s;
+
+      *budget -= len / 16;
+      if (len <= buflen - pos && memcmp (buf + s, buf + pos, len) == 0)
+        f->lo = f->hi = pos + len;
+      else
+        f->lo = pos + 1, f->hi = pos;
+    }
+  else
+    {
+      idx_t end = pos;
+
+      while (end < buflen && e->set[(unsigned char) buf[end]]
+             && (e->repeat || end == pos))
+        end++;
+      *budget -= (end - pos) / 16;
+      f->lo = e->optional ? pos : pos + 1;
+      f->hi = end;
+    }
+  return false;
+}
+
+/* Return 1 if the pattern matches at POS0, 0 if it does not, or -1 if
+   BUDGET runs out first.  */
+static int
+match_at (struct backref *br, const char *buf, idx_t buflen, idx_t pos0,
+          idx_t *budget)
+{
+  int sp = 0;
+
+  enter_elt (br, 0, pos0);
+  if (start_elt (br, buf, buflen, 0, pos0, &sp, budget))
+    return 1;
+
+  while (sp > 0)
+    {
+      struct backref_frame *f = &br->stack[sp - 1];
+      idx_t end;
+
+      if (*budget < 0)
+        return -1;
+
+      if (f->hi < f->lo)
+        {
+          idx_t key[2 + 2 * BACKREF_GROUPS];
+
+          memo_key (br, key, f->elt, f->pos);
+          memo_add (br, key);
+          sp--;
+          continue;
+        }
+
+      end = f->hi--;
+      enter_elt (br, f->elt + 1, end);
+      if (start_elt (br, buf, buflen, f->elt + 1, end, &sp, budget))
+        return 1;
+    }
+
+  return 0;
+}
+
+/* Search BUF, of length BUFLEN, for a match of BR starting between
+   START and START + RANGE, taking at most *STEPS steps, and subtract
+   from *STEPS those taken.  Return the start of the leftmost match, -1
+   if there is none, or -2 if the search took too long to tell.  */
+idx_t
+backref_search (struct backref *br, const char *buf, idx_t buflen,
+                idx_t start, idx_t range, idx_t *steps)
+{
+  idx_t budget, pos, ret = -1;
+
+  if (br->anchor_start)
+    {
+      if (start > 0)
+        return -1;
+      range = 0;
+    }
+
+  if (ckd_mul (&budget, buflen - start + 1, BACKREF_STEPS_PER_BYTE))
+    budget = IDX_MAX;
+  budget = MIN (budget, *steps);
+  *steps -= budget;
+  br->epoch++;
+  br->memo_count = 0;
+
+  for (pos = start; pos - start <= range && pos <= buflen; pos++)
+    {
+      int r = match_at (br, buf, buflen, pos, &budget);
+      if (r != 0)
+        {
+          ret = r < 0 ? -2 : pos;
+          break;
+        }
+    }
+
+  *steps += MAX (budget, 0);
+  return ret;
+}
@@ -20,10 +20,12 @@
 #include <stdckdint.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <obstack.h>
+#include "minmax.h"
 #include "progname.h"
 #include "xalloc.h"
 
@@ -112,20 +114,37 @@ static struct obstack obs;
 static struct output *file_read = NULL;
 static struct output *file_write = NULL;
 
-/* Complain about a programming error and exit.
-   bad_prog translates WHY, bad_prog_notranslate does not.  */
-static _Noreturn void _GL_ATTRIBUTE_FORMAT_PRINTF_STANDARD (1, 0)
-vbad_prog (char const *why, va_list ap)
+/* The complaints of perf_prog, with where they were made.  They are
+   kept until check_final_program, since --strict-perf may come after
+   the scripts on the command line.  */
+struct perf_note {
+  struct error_info where;
+  ptrdiff_t offset;
+  char const *why;
+  struct perf_note *next;
+};
+static struct perf_note *perf_notes = NULL;
+static struct perf_note **perf_notes_tail = &perf_notes;
+
+/* Print that WHERE, at OFFSET in an -e expression, is where the
+   program was read, to start a message.  */
+static void
+print_prog_location (struct error_info const *where, ptrdiff_t offset)
 {
-  if (cur_input.name)
+  if (where->name)
     fprintf (stderr, _("%s: file %s line %jd: "), program_name,
-             cur_input.name, cur_input.line);
+             where->name, where->line);
   else
     fprintf (stderr, _("%s: -e expression #%d, char %td: "),
-             program_name,
-             cur_input.string_expr_count,
-             prog.cur - prog.base);
+             program_name, where->string_expr_count, offset);
+}
 
+/* Complain about a programming error and exit.
+   bad_prog translates WHY, bad_prog_notranslate does not.  */
+static _Noreturn void _GL_ATTRIBUTE_FORMAT_PRINTF_STANDARD (1, 0)
+vbad_prog (char const *why, va_list ap)
+{
+  print_prog_location (&cur_input, prog.cur - prog.base);
   vfprintf (stderr, why, ap);
   fputc ('\n', stderr);
 
@@ -148,6 +167,47 @@ bad_prog_notranslate (const char *why, ...)
   va_end (ap);
 }
 
+/* Note that the regex just read may be slow to match, for WHY, so
+   that report_perf_notes can tell where it is.  */
+void
+perf_prog (char const *why)
+{
+  struct perf_note *n = XNMALLOC (1, struct perf_note);
+
+  n->where = cur_input;
+  n->offset = prog.cur - prog.base;
+  n->why = why;
+  n->next = NULL;
+  *perf_notes_tail = n;
+  perf_notes_tail = &n->next;
+}
+
+/* Report the notes of perf_prog: as an error, exiting, with
+   --strict-perf, or as warnings with --strict-perf=warn.  */
+static void
+report_perf_notes (void)
+{
+  struct perf_note *n, *next;
+
+  for (n = perf_notes; n; n = next)
+    {
+      next = n->next;
+      if (strict_perf != STRICT_PERF_NONE)
+        {
+          print_prog_location (&n->where, n->offset);
+          if (strict_perf == STRICT_PERF_WARN)
+            fputs (_("warning: "), stderr);
+          fputs (gettext (n->why), stderr);
+          fputc ('\n', stderr);
+          if (strict_perf == STRICT_PERF_ERROR)
+            exit (EXIT_BAD_USAGE);
+        }
+      free (n);
+    }
+  perf_notes = NULL;
+  perf_notes_tail = &perf_notes;
+}
+
 /* Read the next character from the program.  Return EOF if there isn't
    anything to read.  Keep cur_input.line up to date, so error messages
    can be meaningful. */
@@ -367,6 +427,8 @@ next_cmd_entry (struct vector *v)
   cmd->range_state = RANGE_INACTIVE;
   cmd->addr_bang = false;
   cmd->cmd = '\0';	/* something invalid, to catch bugs early */
+  cmd->addr_set = NULL;
+  cmd->addr_set_length = 0;
 
   return cmd;
 }
@@ -902,6 +964,10 @@ compile_program (struct vector *vector)
       vector->v = NULL;
       vector->v_allocated = 0;
       vector->v_length = 0;
+      vector->end_line = -1;
+      vector->end_ranges = NULL;
+      vector->n_end_ranges = 0;
+      vector->empty_regex = false;
 
       obstack_init (&obs);
     }
@@ -1498,6 +1564,341 @@ cleanup_program_filenames (void)
   }
 }
 
+/* Return true if CMD can have a visible effect even when -n is given.  */
+static bool
+visible_command_p (const struct sed_cmd *cmd)
+{
+  switch (cmd->cmd)
+    {
+    case '{': case '}': case '#': case ':':
+    case 'b': case 't': case 'T':
+    case 'd': case 'D': case 'g': case 'G': case 'h': case 'H':
+    case 'n': case 'N': case 'x': case 'y': case 'z':
+      return false;
+
+    case 's':
+      return (cmd->x.cmd_subst->print || cmd->x.cmd_subst->outf
+              || cmd->x.cmd_subst->eval);
+
+    default:
+      return true;
+    }
+}
+
+/* Return the last line number that can satisfy the address of CMD,
+   0 if CMD is a range that can only be satisfied until it is closed,
+   or -1 if there is no such limit.  Two numeric addresses always form
+   a range that cannot match past the larger of the two.  */
+static intmax_t
+address_end_line (const struct sed_cmd *cmd)
+{
+  /* '{' inverts the sense of addr_bang.  */
+  if (!cmd->a1 || cmd->a1->addr_type != ADDR_IS_NUM
+      || cmd->addr_bang != (cmd->cmd == '{'))
+    return -1;
+  if (!cmd->a2)
+    return cmd->a1->addr_number;
+  if (cmd->a2->addr_type == ADDR_IS_NUM)
+    return MAX (cmd->a1->addr_number, cmd->a2->addr_number);
+  return 0;
+}
+
+/* With -n, find out whether every command with a visible effect stops
+   running at some point, so that the rest of the input need not be
+   read, and record when in PROGRAM.  A command stops running when its
+   own numeric address, or that of a block containing it, has passed.
+   Blocks containing labels are not considered, since a branch can get
+   into them without going through the '{'.  */
+static void
+compute_end_line (struct vector *program)
+{
+  idx_t n = program->v_length;
+  idx_t *label_count, *open_blocks, *ranges;
+  idx_t i, depth = 0, n_ranges = 0;
+  intmax_t end_line = 0;
+
+  if (!no_default_output || debug)
+    return;
+
+  /* LABEL_COUNT[I] is the number of labels before command I.  */
+  label_count = XNMALLOC (n + 1, idx_t);
+  label_count[0] = 0;
+  for (i = 0; i < n; i++)
+    label_count[i + 1] = label_count[i] + (program->v[i].cmd == ':');
+
+  open_blocks = XNMALLOC (n, idx_t);
+  ranges = XNMALLOC (n, idx_t);
+  for (i = 0; i < n; i++)
+    {
+      struct sed_cmd *cmd = &program->v[i];
+
+      if (cmd->cmd == '}')
+        depth--;
+
+      if (visible_command_p (cmd))
+        {
+          intmax_t best = address_end_line (cmd);
+          idx_t range = best == 0 ? i : -1;
+          idx_t j;
+
+          for (j = depth; j-- > 0; )
+            {
+              struct sed_cmd *block = &program->v[open_blocks[j]];
+              intmax_t l;
+
+              if (label_count[block->x.jump_index] != label_count[open_blocks[j]])
+                continue;
+
+              l = address_end_line (block);
+              if (l > 0 && (best <= 0 || l < best))
+                best = l;
+              else if (l == 0 && range < 0)
+                range = open_blocks[j];
+            }
+
+          if (best > 0)
+            end_line = MAX (end_line, best);
+          else if (range >= 0)
+            ranges[n_ranges++] = range;
+          else
+            break;
+        }
+
+      if (cmd->cmd == '{')
+        open_blocks[depth++] = i;
+    }
+
+  if (i == n)
+    {
+      program->end_line = end_line;
+      program->end_ranges = ranges;
+      program->n_end_ranges = n_ranges;
+    }
+  else
+    free (ranges);
+
+  free (open_blocks);
+  free (label_count);
+}
+
+/* Return true if CMD is addressed by a single, non-empty regex, and so
+   is skipped, with no side effect, if the regex does not match.  */
+static bool
+regex_addressed_p (const struct sed_cmd *cmd)
+{
+  return (cmd->a1 && cmd->a1->addr_type == ADDR_IS_REGEX
+          && cmd->a1->addr_regex && !cmd->a2 && !cmd->addr_bang
+          && cmd->cmd != '{');
+}
+
+/* Set PROGRAM->empty_regex if an address or an 's' command of PROGRAM
+   uses the empty regex.  */
+static void
+compute_empty_regex (struct vector *program)
+{
+  idx_t i;
+
+  for (i = 0; i < program->v_length; i++)
+    {
+      struct sed_cmd *cmd = &program->v[i];
+
+      if ((cmd->a1 && cmd->a1->addr_type == ADDR_IS_REGEX
+           && !cmd->a1->addr_regex)
+          || (cmd->a2 && cmd->a2->addr_type == ADDR_IS_REGEX
+              && !cmd->a2->addr_regex)
+          || (cmd->cmd == 's' && !cmd->x.cmd_subst->regx))
+        program->empty_regex = true;
+    }
+}
+
+/* Combine the regexes of each run of consecutive commands for which
+   regex_addressed_p holds, so that execute_program can rule out the
+   whole run with a single DFA scan of the pattern space.  Since the
+   commands skipped that way do not update the regex that '//' stands
+   for, nothing is done if the program contains an empty regex.  */
+static void
+compute_address_sets (struct vector *program)
+{
+  idx_t n = program->v_length;
+  struct regex **regexes;
+  idx_t i, j, k;
+
+  if (debug || program->empty_regex)
+    return;
+
+  regexes = XNMALLOC (n, struct regex *);
+  for (i = 0; i < n; i = j)
+    {
+      if (!regex_addressed_p (&program->v[i]))
+        {
+          j = i + 1;
+          continue;
+        }
+
+      regexes[0] = program->v[i].a1->addr_regex;
+      for (j = i + 1; j < n; j++)
+        {
+          struct sed_cmd *cmd = &program->v[j];
+          if (!regex_addressed_p (cmd)
+              || cmd->a1->addr_regex->flags != regexes[0]->flags)
+            break;
+          regexes[j - i] = cmd->a1->addr_regex;
+        }
+
+      k = j - i;
+      if (k > 1)
+        {
+          program->v[i].addr_set = compile_regex_set (regexes, k);
+          if (program->v[i].addr_set)
+            program->v[i].addr_set_length = k;
+        }
+    }
+  free (regexes);
+}
+
+/* Add to the set SET of regexes, a bit array, those that the addresses
+   of CMD may leave as the last one used, given that SET holds those
+   that may be the last one used before.  IDS are the indices in sets
+   of the regexes of the addresses of CMD.  */
+static void
+address_last_regexes (const struct sed_cmd *cmd, const idx_t *ids,
+                      unsigned long *set, idx_t words)
+{
+  int bits = CHAR_BIT * sizeof *set;
+
+  /* A lone regex address is always tried.  */
+  if (ids[0] >= 0 && !cmd->a2)
+    memset (set, 0, words * sizeof *set);
+  for (int k = 0; k < 2; k++)
+    if (ids[k] >= 0)
+      set[ids[k] / bits] |= 1UL << (ids[k] % bits);
+}
+
+/* The empty regex of an 's' command stands for the regex used last,
+   which match_regex would have to recompile if it was compiled without
+   registers, as for an address.  Find which regexes may be the last
+   one used when each such command runs, by propagating the sets of
+   those regexes along the jumps of the program until nothing changes,
+   and compile those regexes with registers now.  */
+static void
+compile_reused_regexes (struct vector *program)
+{
+  idx_t n = program->v_length;
+  int bits = CHAR_BIT * sizeof (unsigned long);
+  idx_t *ids, n_ids = 0, words, i;
+  struct regex **regexes;
+  unsigned long *in, *set;
+  int *needed;
+  bool changed;
+
+  for (i = 0; i < n; i++)
+    if (program->v[i].cmd == 's' && !program->v[i].x.cmd_subst->regx)
+      break;
+  if (i == n)
+    return;
+
+  /* IDS[3 * I + K] is the index of the regex of the first address of
+     command I if K is 0, of the second if K is 1, or of the regex of
+     an 's' command if K is 2; or -1 if there is none.  */
+  ids = XNMALLOC (3 * n, idx_t);
+  regexes = XNMALLOC (3 * n, struct regex *);
+  for (i = 0; i < n; i++)
+    {
+      struct sed_cmd *cmd = &program->v[i];
+      struct regex *r[3];
+
+      r[0] = cmd->a1 && cmd->a1->addr_type == ADDR_IS_REGEX
+             ? cmd->a1->addr_regex : NULL;
+      r[1] = cmd->a2 && cmd->a2->addr_type == ADDR_IS_REGEX
+             ? cmd->a2->addr_regex : NULL;
+      r[2] = cmd->cmd == 's' ? cmd->x.cmd_subst->regx : NULL;
+      for (int k = 0; k < 3; k++)
+        {
+          ids[3 * i + k] = r[k] ? n_ids : -1;
+          if (r[k])
+            regexes[n_ids++] = r[k];
+        }
+    }
+
+  /* IN[I] is the set of the regexes that may be the last one used when
+     command I is reached.  */
+  words = n_ids / bits + 1;
+  in = xcalloc (n * words, sizeof *in);
+  set = XNMALLOC (words, unsigned long);
+  do
+    {
+      changed = false;
+      for (i = 0; i < n; i++)
+        {
+          struct sed_cmd *cmd = &program->v[i];
+          idx_t next[2], j, w;
+          int n_next = 0;
+
+          memcpy (set, in + i * words, words * sizeof *set);
+          address_last_regexes (cmd, ids + 3 * i, set, words);
+          if (ids[3 * i + 2] >= 0)
+            {
+              if (!cmd->a1)
+                memset (set, 0, words * sizeof *set);
+              set[ids[3 * i + 2] / bits] |= 1UL << (ids[3 * i + 2] % bits);
+            }
+
+          /* The commands that may run next.  The program starts over
+             after its end, or after a command that ends the cycle.  */
+          next[n_next++] = i + 1 < n ? i + 1 : 0;
+          switch (cmd->cmd)
+            {
+            case '{': case 'b': case 't': case 'T':
+              next[n_next++] = cmd->x.jump_index < n ? cmd->x.jump_index : 0;
+              break;
+            case 'c': case 'd': case 'D':
+              next[n_next++] = 0;
+              break;
+            }
+
+          for (j = 0; j < n_next; j++)
+            for (w = 0; w < words; w++)
+              if (set[w] & ~in[next[j] * words + w])
+                {
+                  in[next[j] * words + w] |= set[w];
+                  changed = true;
+                }
+        }
+    }
+  while (changed);
+
+  /* Compile the regexes that an 's' command may use through the empty
+     regex, with as many registers as any such command needs.  */
+  needed = xcalloc (n_ids ? n_ids : 1, sizeof *needed);
+  for (i = 0; i < n; i++)
+    {
+      struct sed_cmd *cmd = &program->v[i];
+      idx_t id;
+
+      if (cmd->cmd != 's' || cmd->x.cmd_subst->regx)
+        continue;
+      memcpy (set, in + i * words, words * sizeof *set);
+      address_last_regexes (cmd, ids + 3 * i, set, words);
+      for (id = 0; id < n_ids; id++)
+        if (set[id / bits] & (1UL << (id % bits)))
+          needed[id] = MAX (needed[id], cmd->x.cmd_subst->max_id + 1);
+    }
+
+  /* A regex with fewer groups than needed is left for match_regex,
+     which reports the error when that regex is actually used.  */
+  for (idx_t id = 0; id < n_ids; id++)
+    if (needed[id] && regexes[id]->pattern.no_sub
+        && !(posixicity == POSIXLY_EXTENDED
+             && regexes[id]->pattern.re_nsub < needed[id] - 1))
+      recompile_regex (regexes[id], needed[id]);
+
+  free (needed);
+  free (set);
+  free (in);
+  free (regexes);
+  free (ids);
+}
+
 /* Make any checks which require the whole program to have been read.
    In particular: this backpatches the jump targets.
    Any cleanup which can be done after these checks is done here also.  */
@@ -1547,6 +1948,13 @@ check_final_program (struct vector *program)
   for (lbl = labels; lbl; lbl = release_label (lbl))
     ;
   labels = NULL;
+
+  report_perf_notes ();
+
+  compute_end_line (program);
+  compute_empty_regex (program);
+  compute_address_sets (program);
+  compile_reused_regexes (program);
 }
 
 
@@ -1604,6 +2012,11 @@ finish_program (struct vector *program)
         release_regex (sc->a1->addr_regex);
       if (sc->a2 && sc->a2->addr_regex)
         release_regex (sc->a2->addr_regex);
+      if (sc->addr_set)
+        {
+          dfafree (sc->addr_set);
+          free (sc->addr_set);
+        }
 
       switch (sc->cmd)
         {
@@ -1615,6 +2028,7 @@ finish_program (struct vector *program)
         }
     }
 
+  free (program->end_ranges);
   obstack_free (&obs, NULL);
 #else
   (void)program;
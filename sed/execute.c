@@ -16,6 +16,8 @@
 
 #define INITIAL_BUFFER_SIZE	50
 #define FREAD_BUFFER_SIZE	8192
+#define INPUT_BLOCK_SIZE	(1024 * 1024)
+#define LINE_INDEX_INTERVAL	4096
 
 #include "sed.h"
 
@@ -25,15 +27,18 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "stat-macros.h"
+#include "stat-time.h"
 
 #include <selinux/selinux.h>
 #include <selinux/context.h>
 #include "acl.h"
+#include "binary-io.h"
 #include "ignore-value.h"
 #include "minmax.h"
 #include "progname.h"
@@ -53,6 +58,8 @@ struct line {
                         /* 0 <= LENGTH <= ALLOC, and the malloc
                            size is ACTIVE - TEXT + ALLOC + DFA_SLOP.  */
   bool chomped;		/* Was a trailing newline dropped? */
+  intmax_t generation;	/* Changed whenever the text is; see line_changed. */
+  intmax_t prefix_generation; /* Kept as text is appended; see line_grown. */
   mbstate_t mbstate;
 };
 
@@ -101,7 +108,16 @@ struct input {
   /* if NULL, none of the following are valid */
   FILE *fp;
 
+  /* If set, read the input a line at a time through stdio rather than
+     in large blocks, so that no more is consumed than is needed.  */
   bool no_buffering;
+
+  /* True once a block read has hit end of file.  */
+  bool eof;
+
+  /* Where the file offset was when the file was opened, or -1 if it
+     cannot be told; line 1 starts there.  */
+  off_t start_offset;
 };
 
 
@@ -121,12 +137,58 @@ static struct line s_accum;
 static struct line hold;
 
 /* The buffered input look-ahead.  The only field that should be
-   used outside of read_mem_line() or line_init() is buffer.length. */
+   used outside of read_mem_line(), read_input_block(), skip_lines()
+   or line_init() is buffer.length.  */
 static struct line buffer;
 
+/* Incremented whenever the data in BUFFER may have moved, so that
+   pointers into it that were saved by skip_lines() can be discarded.  */
+static unsigned int buffer_generation;
+
+/* When every command of the program is addressed by a regular
+   expression or by line numbers, the lines on which no command runs
+   can be found without running the program: the look-ahead is scanned
+   for the next line that could match one of the regular expressions,
+   and the line numbers tell where the other addresses match.  The
+   lines before that are output in bulk (or dropped, with -n) without
+   ever reaching the pattern space.  Likewise, a span of lines on which
+   the first command to run is 'd' is dropped in bulk.  A '$' address
+   can only match the last line of the look-ahead, and '$!d' drops
+   every line before it.
+
+   skip_cmds lists the top-level commands of such a program, in order.
+   For those with a regex address, NEXT caches the start of the next
+   line that the regex could match, or the end of the scanned data if
+   there is none, and is valid as long as GENERATION equals
+   buffer_generation.  */
+struct skip_cmd {
+  struct sed_cmd *cmd;
+  char *next;
+  unsigned int generation;
+};
+
+static struct skip_cmd *skip_cmds;
+static idx_t skip_cmds_count;
+
+/* Whether the program can tell the line number of a line, so that the
+   lines skipped by skip_lines must be counted.  */
+static bool skip_counts_lines;
+
+/* The offsets kept in the --line-index file: line_index[K] is where
+   line (K + 1) * line_index_interval + 1 starts in the input file.
+   line_index_interval is zero until the index has been loaded.  */
+static idx_t *line_index;
+static idx_t line_index_count;
+static intmax_t line_index_interval;
+
 static struct append_queue *append_head = NULL;
 static struct append_queue *append_tail = NULL;
 
+/* The command being run and the input being read, for the errors
+   that matching a regex may report.  */
+static struct sed_cmd *current_cmd;
+static struct input *current_input;
+
 /* Prepare to increase LB's length by LEN, making some attempt at
    keeping realloc() calls under control by padding for future growth.  */
 static void
@@ -155,10 +217,34 @@ resize_line (struct line *lb, idx_t len)
   lb->active = lb->text + inactive;
 }
 
+/* The last generation given to a line by line_changed.  */
+static intmax_t line_generation;
+
+/* Give LB a new generation, so that match_regex does not reuse what
+   it found in the former contents of LB.  Every change to the text of
+   a line that match_regex may see must be followed by a call to this
+   function, unless it is done with one of the functions below.  */
+static void
+line_changed (struct line *lb)
+{
+  lb->generation = lb->prefix_generation = ++line_generation;
+}
+
+/* Like line_changed, for LB whose text was only added to at the end.
+   Its text as of any generation since its prefix generation last
+   changed is thus a prefix of its current text, and match_regex can
+   skip that part if a regex did not match it.  */
+static void
+line_grown (struct line *lb)
+{
+  lb->generation = ++line_generation;
+}
+
 /* Append LENGTH bytes from STRING to the line, TO.  */
 static void
 str_append (struct line *to, const char *string, idx_t length)
 {
+  line_grown (to);
   if (to->alloc - to->length < length)
     resize_line (to, length);
   idx_t new_length = to->length + length;
@@ -295,6 +381,7 @@ line_init (struct line *buf, struct line *state, idx_t initial_size)
 static void
 line_reset (struct line *buf, struct line *state)
 {
+  line_changed (buf);
   if (buf->alloc == 0)
     line_init (buf, state, INITIAL_BUFFER_SIZE);
   else
@@ -330,6 +417,7 @@ line_copy (struct line *from, struct line *to, int state)
   to->length = from->length;
   to->chomped = from->chomped;
   memcpy (to->active, from->active, from->length);
+  line_changed (to);
 
   if (state)
     memcpy (&to->mbstate, &from->mbstate, sizeof (from->mbstate));
@@ -376,6 +464,77 @@ read_always_fail (struct input *input _GL_UNUSED)
   return false;
 }
 
+/* Append a block of input to the look-ahead BUFFER, reading it
+   directly from the file descriptor.  Return false if nothing more
+   could be read.  */
+static bool
+read_input_block (struct input *input)
+{
+  idx_t n;
+
+  if (!input->fp || input->eof)
+    return false;
+
+  /* Move the unread data to the front of the buffer, and make room
+     for a whole block after it.  */
+  if (buffer.active != buffer.text)
+    {
+      memmove (buffer.text, buffer.active, buffer.length);
+      buffer.alloc += buffer.active - buffer.text;
+      buffer.active = buffer.text;
+    }
+  if (buffer.alloc - buffer.length < INPUT_BLOCK_SIZE)
+    resize_line (&buffer, INPUT_BLOCK_SIZE);
+
+  n = ck_read (buffer.active + buffer.length, buffer.alloc - buffer.length,
+               input->fp);
+  buffer_generation++;
+  if (n == 0)
+    input->eof = true;
+  buffer.length += n;
+  return n > 0;
+}
+
+/* Read one line from the look-ahead BUFFER, refilling it from the
+   input with read_input_block as needed.  The line is copied straight
+   from there into the pattern space, without going through stdio.  */
+static bool
+read_mem_line (struct input *input)
+{
+  char *e;
+  idx_t l, scanned = 0;
+
+  for (;;)
+    {
+      e = memchr (buffer.active + scanned, buffer_delimiter,
+                  buffer.length - scanned);
+      if (e)
+        break;
+      scanned = buffer.length;
+      if (!read_input_block (input))
+        break;
+    }
+
+  if (!buffer.length)
+    return false;
+
+  if (e)
+    l = e - buffer.active;
+  else
+    {
+      l = buffer.length;
+      line.chomped = false;
+    }
+
+  str_append (&line, buffer.active, l);
+
+  if (e)
+    l++;
+  buffer.active += l;
+  buffer.length -= l;
+  return true;
+}
+
 static bool
 read_file_line (struct input *input)
 {
@@ -420,16 +579,35 @@ output_line (const char *text, idx_t length, int nl, struct output *outf)
     return;
 
   output_missing_newline (outf);
-  if (length)
-    ck_fwrite (text, 1, length, outf->fp);
   if (nl)
-    ck_fwrite (&buffer_delimiter, 1, 1, outf->fp);
+    ck_fwrite_delim (text, length, buffer_delimiter, outf->fp);
   else
-    outf->missing_newline = true;
+    {
+      ck_fwrite (text, 1, length, outf->fp);
+      outf->missing_newline = true;
+    }
 
   flush_output (outf->fp);
 }
 
+/* Output the line number N followed by the line delimiter, as the '='
+   command does.  The digits are formatted by hand, since this is much
+   cheaper than going through printf for every line.  */
+static void
+output_line_number (intmax_t n, struct output *outf)
+{
+  char buf[sizeof n * CHAR_BIT / 3 + 1];
+  char *p = buf + sizeof buf;
+
+  do
+    *--p = '0' + n % 10;
+  while ((n /= 10) != 0);
+
+  output_missing_newline (outf);
+  ck_fwrite_delim (p, buf + sizeof buf - p, buffer_delimiter, outf->fp);
+  flush_output (outf->fp);
+}
+
 static struct append_queue *
 next_append_slot (void)
 {
@@ -570,7 +748,13 @@ open_next_file (const char *name, struct input *input)
         }
     }
 
-  input->read_fn = read_file_line;
+  /* Unless told otherwise, read the file in large blocks rather than
+     a line at a time.  The file is not mapped into memory: the mapping
+     would fault if the file were truncated while sed reads it, and would
+     miss what is appended to it.  */
+  input->eof = false;
+  input->start_offset = lseek (fileno (input->fp), 0, SEEK_CUR);
+  input->read_fn = input->no_buffering ? read_file_line : read_mem_line;
 
   if (in_place_extension)
     {
@@ -650,6 +834,12 @@ closedown (struct input *input)
   if (!input->fp)
     return;
 
+  /* Give back the look-ahead that was read but not used, if the
+     input allows it; this matters for "(sed 1q; cat) < file".  */
+  if (buffer.length)
+    lseek (fileno (input->fp), -buffer.length, SEEK_CUR);
+  buffer.length = 0;
+
   if (in_place_extension && output_file.fp != NULL)
     {
       const char *target_name;
@@ -712,7 +902,10 @@ read_pattern_space (struct input *input, struct vector *the_program, int append)
     dump_append_queue ();
   replaced = false;
   if (!append)
-    line.length = 0;
+    {
+      line.length = 0;
+      line_changed (&line);
+    }
   line.chomped = true;  /* default, until proved otherwise */
 
   while ( ! (*input->read_fn)(input) )
@@ -726,6 +919,7 @@ read_pattern_space (struct input *input, struct vector *the_program, int append)
         {
           input->line_number = 0;
           hold.length = 0;
+          line_changed (&hold);
           reset_addresses (the_program);
           rewind_read_files ();
 
@@ -751,25 +945,57 @@ read_pattern_space (struct input *input, struct vector *the_program, int append)
   return true;
 }
 
+/* Return true if there is nothing left to read from the current
+   input file.  */
+static bool
+input_exhausted_p (struct input *input)
+{
+  int ch;
+
+  if (buffer.length)
+    return false;
+  if (!input->fp)
+    return true;
+  if (input->read_fn == read_mem_line)
+    return !read_input_block (input);
+  if (feof (input->fp))
+    return true;
+  if ((ch = getc (input->fp)) == EOF)
+    return true;
+  ungetc (ch, input->fp);
+  return false;
+}
+
+/* Return true if the file named NAME is known to have data without
+   opening it, i.e. it is a readable regular file that is not empty.
+   Some regular files, such as those in /proc, have a size of zero even
+   though they can be read, so an empty file proves nothing.  */
+static bool
+file_has_data_p (const char *name)
+{
+  struct stat st;
+
+  return (!(name[0] == '-' && name[1] == '\0')
+          && stat (name, &st) == 0 && S_ISREG (st.st_mode)
+          && 0 < st.st_size && access (name, R_OK) == 0);
+}
+
 static bool
 last_file_with_data_p (struct input *input)
 {
+  /* Answer from the next file's status when possible, so that the
+     current file stays open and the next one is opened as usual.  */
+  if (*input->file_list && file_has_data_p (*input->file_list))
+    return false;
+
   for (;;)
     {
-      int ch;
-
       closedown (input);
       if (!*input->file_list)
         return true;
       open_next_file (*input->file_list++, input);
-      if (input->fp)
-        {
-          if ((ch = getc (input->fp)) != EOF)
-            {
-              ungetc (ch, input->fp);
-              return false;
-            }
-        }
+      if (!input_exhausted_p (input))
+        return false;
     }
 }
 
@@ -777,18 +1003,9 @@ last_file_with_data_p (struct input *input)
 static bool
 test_eof (struct input *input)
 {
-  int ch;
-
-  if (buffer.length)
+  if (!input_exhausted_p (input))
     return false;
-  if (!input->fp)
-    return separate_files || last_file_with_data_p (input);
-  if (feof (input->fp))
-    return separate_files || last_file_with_data_p (input);
-  if ((ch = getc (input->fp)) == EOF)
-    return separate_files || last_file_with_data_p (input);
-  ungetc (ch, input->fp);
-  return false;
+  return separate_files || last_file_with_data_p (input);
 }
 
 /* Return non-zero if the current line matches the address
@@ -803,7 +1020,7 @@ match_an_address_p (struct addr *addr, struct input *input)
 
     case ADDR_IS_REGEX:
       return match_regex (addr->addr_regex, line.active, line.length, 0,
-                         NULL, 0);
+                          NULL, 0, line.generation, line.prefix_generation);
 
     case ADDR_IS_NUM_MOD:
       return (input->line_number >= addr->addr_number
@@ -970,7 +1187,7 @@ do_list (intmax_t line_len)
 
 
 static void append_replacement (struct line *buf, struct replacement *p,
-                                struct re_registers *regs)
+                                struct match_regs *regs)
 {
   enum replacement_types repl_mod = 0;
 
@@ -1010,6 +1227,25 @@ static void append_replacement (struct line *buf, struct replacement *p,
     }
 }
 
+/* Report that matching REGEX for the current command took more steps
+   than --regex-step-limit allows, or if TIMED_OUT more time than
+   --regex-timeout allows, and exit.  */
+void
+regex_overrun_error (const struct regex *regex, bool timed_out)
+{
+  intmax_t line_number = current_input ? current_input->line_number : 0;
+  char cmd = current_cmd ? current_cmd->cmd : '?';
+  int len = MIN (regex->sz, INT_MAX);
+
+  if (timed_out)
+    panic (_("input line %jd: regex '%.*s' of command '%c' timed out"),
+           line_number, len, regex->re, cmd);
+  else
+    panic (_("input line %jd: regex '%.*s' of command '%c' "
+             "took too many steps"),
+           line_number, len, regex->re, cmd);
+}
+
 static void
 do_subst (struct subst *sub)
 {
@@ -1018,14 +1254,14 @@ do_subst (struct subst *sub)
   idx_t count = 0;	/* number of matches found */
   bool again = true;
 
-  static struct re_registers regs;
+  static struct match_regs regs;
 
   line_reset (&s_accum, &line);
 
   /* The first part of the loop optimizes s/xxx// when xxx is at the
      start, and s/xxx$// */
   if (!match_regex (sub->regx, line.active, line.length, start,
-                    &regs, sub->max_id + 1))
+                    &regs, sub->max_id + 1, line.generation, 0))
     return;
 
   if (debug)
@@ -1033,13 +1269,13 @@ do_subst (struct subst *sub)
       if (regs.num_regs>0 && regs.start[0] != -1)
         puts ("MATCHED REGEX REGISTERS");
 
-      for (int i = 0; i < regs.num_regs; ++i)
+      for (idx_t i = 0; i < regs.num_regs; ++i)
         {
           if (regs.start[i] == -1)
             break;
 
-          printf ("  regex[%d] = %d-%d '", i,
-                  (int)regs.start[i], (int)regs.end[i]);
+          printf ("  regex[%jd] = %jd-%jd '", (intmax_t) i,
+                  (intmax_t) regs.start[i], (intmax_t) regs.end[i]);
 
           if (regs.start[i] != regs.end[i])
             fwrite (line.active + regs.start[i], regs.end[i] -regs.start[i],
@@ -1059,6 +1295,7 @@ do_subst (struct subst *sub)
           line.active += regs.end[0];
           line.length -= regs.end[0];
           line.alloc -= regs.end[0];
+          line_changed (&line);
           goto post_subst;
         }
       else if (regs.end[0] == line.length)
@@ -1067,6 +1304,7 @@ do_subst (struct subst *sub)
           replaced = true;
 
           line.length = regs.start[0];
+          line_changed (&line);
           goto post_subst;
         }
     }
@@ -1127,7 +1365,7 @@ do_subst (struct subst *sub)
   while (again
          && start <= line.length
          && match_regex (sub->regx, line.active, line.length, start,
-                         &regs, sub->max_id + 1));
+                         &regs, sub->max_id + 1, line.generation, 0));
 
   /* Copy stuff to the right of the last match into the output string. */
   if (start < line.length)
@@ -1173,7 +1411,10 @@ do_subst (struct subst *sub)
           line_exchange (&line, &s_accum, true);
           if (line.length
               && line.active[line.length - 1] == buffer_delimiter)
-            line.length--;
+            {
+              line.length--;
+              line_changed (&line);
+            }
         }
       else
         panic (_("error in subprocess"));
@@ -1288,12 +1529,20 @@ execute_program (struct vector *vec, struct input *input)
   end_cmd = vec->v + vec->v_length;
   while (cur_cmd < end_cmd)
     {
+      if (cur_cmd->addr_set
+          && !match_regex_set (cur_cmd->addr_set, line.active, line.length))
+        {
+          cur_cmd += cur_cmd->addr_set_length;
+          continue;
+        }
+
       if (debug)
         {
           fputs ("COMMAND: ", stdout);
           debug_print_command (vec, cur_cmd);
         }
 
+      current_cmd = cur_cmd;
       if (match_address_p (cur_cmd, input) != cur_cmd->addr_bang)
         {
           switch (cur_cmd->cmd)
@@ -1340,6 +1589,7 @@ execute_program (struct vector *vec, struct input *input)
                 line.alloc -= p - line.active;
                 line.length -= p - line.active;
                 line.active += p - line.active;
+                line_changed (&line);
 
                 /* reset to start next cycle without reading a new line: */
                 cur_cmd = vec->v;
@@ -1391,7 +1641,10 @@ execute_program (struct vector *vec, struct input *input)
                     if (s_accum.length
                         && (s_accum.active[s_accum.length - 1]
                             == buffer_delimiter))
-                      s_accum.length--;
+                      {
+                        s_accum.length--;
+                        line_changed (&s_accum);
+                      }
 
                     /* Exchange line and s_accum.  This can be much
                        cheaper than copying s_accum.active into line.text
@@ -1479,6 +1732,7 @@ execute_program (struct vector *vec, struct input *input)
                   if (debug)
                     debug_print_end_of_cycle ();
                   line.length--;
+                  line_changed (&line);
                   if (posixicity == POSIXLY_EXTENDED && !no_default_output)
                      output_line (line.active, line.length, line.chomped,
                                   &output_file);
@@ -1613,29 +1867,25 @@ execute_program (struct vector *vec, struct input *input)
                   for (e=p+line.length; p<e; ++p)
                     *p = cur_cmd->x.translate[*p];
                 }
+              line_changed (&line);
               if (debug)
                 debug_print_line (&line);
               break;
 
             case 'z':
               line.length = 0;
+              line_changed (&line);
               if (debug)
                 debug_print_line (&line);
               break;
 
             case '=':
-              output_missing_newline (&output_file);
-              fprintf (output_file.fp, "%jd%c", input->line_number,
-                       buffer_delimiter);
-              flush_output (output_file.fp);
+              output_line_number (input->line_number, &output_file);
              break;
 
            case 'F':
-              output_missing_newline (&output_file);
-              fprintf (output_file.fp, "%s%c",
-                       input->in_file_name,
-                       buffer_delimiter);
-              flush_output (output_file.fp);
+              output_line (input->in_file_name, strlen (input->in_file_name),
+                           true, &output_file);
              break;
 
            default:
@@ -1655,6 +1905,593 @@ execute_program (struct vector *vec, struct input *input)
 }
 
 
+/* Return true if ADDR is a regular expression whose matches can be
+   found by running its DFA over a whole buffer.  */
+static bool
+skip_regex_address_p (struct addr *addr)
+{
+  struct regex *regex = addr->addr_regex;
+
+  /* The empty regular expression depends on what ran before, '^'
+     and '$' match every line, and the DFA cannot see the line
+     structure within a line when M is used with -z.  */
+  return (addr->addr_type == ADDR_IS_REGEX
+          && regex && !regex->begline && !regex->endline
+          && !((regex->flags & REG_NEWLINE) && buffer_delimiter != '\n')
+          && (dfasuperset (regex->dfa) || dfasupported (regex->dfa)));
+}
+
+/* Return true if ADDR depends on the line number.  */
+static bool
+numeric_address_p (struct addr *addr)
+{
+  return (addr && addr->addr_type != ADDR_IS_REGEX
+          && addr->addr_type != ADDR_IS_LAST);
+}
+
+/* Find out whether the lines on which no command runs can be told
+   without running THE_PROGRAM, and if so fill skip_cmds.  This is the
+   case when every command other than labels and block ends has a
+   single regex address, a single line number, a FIRST~STEP address,
+   a '$' address or a range between two line numbers, and no '!'
+   except in '$!d'.  The contents of a block need not be checked, as
+   they only run on the lines that the block's address matches.  */
+static void
+setup_line_skipping (struct vector *the_program)
+{
+  struct sed_cmd *cur_cmd, *end_cmd;
+  idx_t n = 0;
+
+  /* --debug prints every line.  The lines skipped do not go through
+     match_regex, so they would not update the regex that the empty
+     regex stands for.  */
+  if (debug || the_program->empty_regex)
+    return;
+
+  skip_cmds = XNMALLOC (the_program->v_length, struct skip_cmd);
+  end_cmd = the_program->v + the_program->v_length;
+  for (cur_cmd = the_program->v; cur_cmd < end_cmd; cur_cmd++)
+    {
+      struct addr *a1 = cur_cmd->a1, *a2 = cur_cmd->a2;
+
+      if (cur_cmd->cmd == ':' || cur_cmd->cmd == '}' || cur_cmd->cmd == '#')
+        continue;
+
+      /* '{' inverts the sense of addr_bang.  */
+      if (!a1
+          || (cur_cmd->addr_bang != (cur_cmd->cmd == '{')
+              && (cur_cmd->cmd != 'd' || a2
+                  || a1->addr_type != ADDR_IS_LAST)))
+        break;
+
+      if (a2
+          ? (a1->addr_type != ADDR_IS_NUM || a2->addr_type != ADDR_IS_NUM)
+          : (a1->addr_type != ADDR_IS_NUM && a1->addr_type != ADDR_IS_NUM_MOD
+             && a1->addr_type != ADDR_IS_LAST && !skip_regex_address_p (a1)))
+        break;
+
+      skip_cmds[n].cmd = cur_cmd;
+      skip_cmds[n].next = NULL;
+      skip_cmds[n].generation = buffer_generation - 1;
+      n++;
+
+      if (cur_cmd->cmd == '{')
+        cur_cmd = the_program->v + cur_cmd->x.jump_index;
+    }
+
+  if (cur_cmd < end_cmd || n == 0)
+    {
+      free (skip_cmds);
+      skip_cmds = NULL;
+      return;
+    }
+
+  skip_cmds_count = n;
+
+  /* regex_overrun_error reports the line number too.  */
+  skip_counts_lines = regex_step_limit || regex_timeout;
+  for (cur_cmd = the_program->v; cur_cmd < end_cmd; cur_cmd++)
+    if (cur_cmd->cmd == '='
+        || numeric_address_p (cur_cmd->a1) || numeric_address_p (cur_cmd->a2))
+      skip_counts_lines = true;
+}
+
+/* Find the first span of lines, starting at line L or later, on which
+   the numeric address of CMD matches, supposing that CMD is reached on
+   every line; store its bounds in *FIRST and *LAST, or INTMAX_MAX if
+   there is none.  This mirrors match_address_p.  */
+static void
+numeric_address_span (struct sed_cmd *cmd, intmax_t l,
+                      intmax_t *first, intmax_t *last)
+{
+  intmax_t n1 = cmd->a1->addr_number;
+
+  *first = *last = INTMAX_MAX;
+
+  if (cmd->a1->addr_type == ADDR_IS_NUM_MOD)
+    {
+      intmax_t step = cmd->a1->addr_step;
+
+      if (l <= n1)
+        *first = n1;
+      else if (ckd_add (first, l, (step - (l - n1) % step) % step))
+        *first = INTMAX_MAX;
+      *last = *first;
+    }
+  else if (!cmd->a2)
+    {
+      if (l <= n1)
+        *first = *last = n1;
+    }
+  else
+    {
+      intmax_t n2 = cmd->a2->addr_number;
+
+      switch (cmd->range_state)
+        {
+        case RANGE_ACTIVE:
+          if (l <= n2)
+            *first = l, *last = n2;
+          break;
+
+        case RANGE_INACTIVE:
+          if (l < n1)
+            *first = n1, *last = MAX (n1, n2);
+          else if (l <= n2)
+            *first = l, *last = n2;
+          else if (l == n1)
+            *first = *last = l;
+          break;
+
+        case RANGE_CLOSED:
+          break;
+        }
+    }
+}
+
+/* Return the start of the first line in [BEG, LIM] that REGEX might
+   match, or LIM + 1 if there is none.  BEG must be the start of a line
+   and LIM must point to a line delimiter.  dfaexec stores its sentinel
+   at LIM, so it must be writable; this is why the look-ahead is always
+   read into BUFFER's own storage rather than used in place.  */
+static char *
+skip_regex_next_line (struct regex *regex, char *beg, char *lim)
+{
+  struct dfa *dfa = dfasuperset (regex->dfa);
+  bool backref = false;
+  char *p;
+
+  if (!dfa)
+    dfa = regex->dfa;
+
+  p = dfaexec (dfa, beg, lim, false, NULL, &backref);
+  if (!p)
+    return lim + 1;
+
+  /* P is the end of the match; go back to the start of its line.  */
+  p = memrchr (beg, buffer_delimiter, p - beg);
+  return p ? p + 1 : beg;
+}
+
+/* Return the number of line delimiters in the LEN bytes at P.  This is
+   a plain loop so that the compiler can vectorize it.  */
+static idx_t
+count_delimiters (const char *p, idx_t len)
+{
+  idx_t i, count = 0;
+
+  for (i = 0; i < len; i++)
+    count += p[i] == buffer_delimiter;
+
+  return count;
+}
+
+/* Return the end of the first N lines in [P, END), N being positive,
+   or END if there are fewer.  END must follow a line delimiter.  */
+static char *
+skip_n_lines (char *p, char *end, intmax_t n)
+{
+  enum { CHUNK = 4096 };
+
+  /* Count whole chunks first, so that short lines do not cost one
+     memchr call each.  */
+  while (end - p > CHUNK)
+    {
+      idx_t count = count_delimiters (p, CHUNK);
+      if (n <= count)
+        break;
+      n -= count;
+      p += CHUNK;
+    }
+
+  while ((p = memchr (p, buffer_delimiter, end - p)))
+    {
+      p++;
+      if (--n == 0)
+        return p;
+    }
+
+  return end;
+}
+
+/* The first line of a --line-index file, which identifies the input
+   file that it was made for: the interval between indexed lines, the
+   line delimiter, and the size, device, inode number and modification
+   time of the file.  */
+#define LINE_INDEX_HEADER "sed-line-index %jd %d %jd %ju %ju %jd %ld\n"
+
+/* Load the --line-index file into line_index, if it was made for the
+   input file whose status is ST.  Return false if it was not, or if it
+   cannot be read.  */
+static bool
+read_line_index (struct stat const *st)
+{
+  FILE *fp = ck_fopen (line_index_file, "r", false);
+  struct timespec mtime = get_stat_mtime (st);
+  intmax_t interval, size, sec, offset, prev = 0;
+  uintmax_t dev, ino;
+  long int nsec;
+  idx_t alloc = 0;
+  int delim;
+  bool ok;
+
+  if (!fp)
+    return false;
+
+  ok = (fscanf (fp, LINE_INDEX_HEADER, &interval, &delim, &size,
+                &dev, &ino, &sec, &nsec) == 7
+        && 0 < interval && delim == (unsigned char) buffer_delimiter
+        && size == st->st_size && dev == st->st_dev && ino == st->st_ino
+        && sec == mtime.tv_sec && nsec == mtime.tv_nsec);
+
+  line_index_count = 0;
+  while (ok && fscanf (fp, "%jd", &offset) == 1)
+    {
+      if (offset <= prev || size <= offset)
+        ok = false;
+      else
+        {
+          if (line_index_count == alloc)
+            line_index = xpalloc (line_index, &alloc, 1, -1,
+                                  sizeof *line_index);
+          line_index[line_index_count++] = prev = offset;
+        }
+    }
+  ok = ok && feof (fp) && !ferror (fp);
+  ck_fclose (fp);
+
+  if (ok)
+    line_index_interval = interval;
+  return ok;
+}
+
+/* Index the lines of the regular file open for INPUT, whose status is
+   ST, and save the index to the --line-index file.  The file is read
+   from the start, and its offset is then put back where it was.  */
+static void
+write_line_index (struct input *input, struct stat const *st)
+{
+  int fd = fileno (input->fp);
+  off_t pos = lseek (fd, 0, SEEK_CUR);
+  char *buf;
+  idx_t alloc = 0, need = LINE_INDEX_INTERVAL, off = 0, n, i;
+  FILE *fp;
+
+  if (pos < 0 || lseek (fd, 0, SEEK_SET) < 0)
+    return;
+
+  buf = ximalloc (INPUT_BLOCK_SIZE);
+  line_index_count = 0;
+  while ((n = ck_read (buf, INPUT_BLOCK_SIZE, input->fp)) > 0)
+    {
+      char *p = buf, *end = buf + n;
+      idx_t count = count_delimiters (buf, n);
+
+      /* Most blocks do not hold an indexed line; just count them.  */
+      if (count < need)
+        need -= count;
+      else
+        while ((p = memchr (p, buffer_delimiter, end - p)))
+          {
+            p++;
+            if (--need)
+              continue;
+            need = LINE_INDEX_INTERVAL;
+            if (off + (p - buf) < st->st_size)
+              {
+                if (line_index_count == alloc)
+                  line_index = xpalloc (line_index, &alloc, 1, -1,
+                                        sizeof *line_index);
+                line_index[line_index_count++] = off + (p - buf);
+              }
+          }
+      off += n;
+    }
+  free (buf);
+  line_index_interval = LINE_INDEX_INTERVAL;
+
+  if (lseek (fd, pos, SEEK_SET) < 0)
+    panic (_("couldn't seek in %s: %s"), input->in_file_name,
+           strerror (errno));
+
+  /* The index is only an optimization, so failing to save it is not
+     an error; it is used for this run anyway.  */
+  fp = fopen (line_index_file, "w");
+  if (fp)
+    {
+      struct timespec mtime = get_stat_mtime (st);
+      fprintf (fp, LINE_INDEX_HEADER, (intmax_t) LINE_INDEX_INTERVAL,
+               (unsigned char) buffer_delimiter, (intmax_t) st->st_size,
+               (uintmax_t) st->st_dev, (uintmax_t) st->st_ino,
+               (intmax_t) mtime.tv_sec, (long int) mtime.tv_nsec);
+      for (i = 0; i < line_index_count; i++)
+        fprintf (fp, "%jd\n", (intmax_t) line_index[i]);
+
+      int err = ferror (fp) ? errno : 0;
+      if (fclose (fp) != 0 && !err)
+        err = errno;
+      if (!err)
+        return;
+      unlink (line_index_file);
+      errno = err;
+    }
+  fprintf (stderr, _("%s: warning: couldn't write line index %s: %s\n"),
+           program_name, line_index_file, strerror (errno));
+}
+
+/* Move the input of INPUT forward to the last indexed line that is not
+   after line LAST + 1, loading or building the index first if needed.
+   The look-ahead is dropped and the file is read again from there.
+   Return true if the input moved.  */
+static bool
+line_index_jump (struct input *input, intmax_t last)
+{
+  int fd = fileno (input->fp);
+  intmax_t k;
+  off_t pos, offset;
+  char c;
+
+  /* The index counts lines from the start of the file, as does sed
+     only if nothing was read from it before, as may be the case for
+     standard input.  */
+  if (input->start_offset != 0)
+    return false;
+
+  if (!line_index_interval)
+    {
+      struct stat st;
+
+      if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode))
+        return false;
+      if (!read_line_index (&st))
+        write_line_index (input, &st);
+    }
+
+  k = MIN (last / line_index_interval, line_index_count);
+  if (k * line_index_interval <= input->line_number)
+    return false;
+
+  /* POS is the offset of the unread input in the file.  */
+  pos = lseek (fd, 0, SEEK_CUR);
+  if (pos < 0)
+    return false;
+  pos -= buffer.length;
+
+  /* Do not trust an index that does not match the file's lines.  */
+  offset = line_index[k - 1];
+  if (offset <= pos
+      || lseek (fd, offset - 1, SEEK_SET) < 0
+      || ck_read (&c, 1, input->fp) != 1 || c != buffer_delimiter)
+    {
+      if (lseek (fd, pos + buffer.length, SEEK_SET) < 0)
+        panic (_("couldn't seek in %s: %s"), input->in_file_name,
+               strerror (errno));
+      return false;
+    }
+
+  buffer.length = 0;
+  buffer_generation++;
+  input->eof = false;
+  input->line_number = k * line_index_interval;
+  return true;
+}
+
+/* Output, without running the program on them, the lines at the front
+   of the input on which no command would run, or discard them if -n
+   was given or if the first command to run on them would be 'd'.
+   Stop at the first line that the program must see, or at the last
+   line of the file.  */
+static void
+skip_lines (struct input *input)
+{
+  if (input->read_fn != read_mem_line)
+    return;
+
+  if (append_head)
+    dump_append_queue ();
+
+  for (;;)
+    {
+      char *beg = buffer.active;
+      char *lim = (buffer.length
+                   ? memrchr (beg, buffer_delimiter, buffer.length)
+                   : NULL);
+
+      if (lim)
+        {
+          intmax_t l = input->line_number + 1;
+          intmax_t span = INTMAX_MAX;
+          bool drop = no_default_output;
+          bool regex = false;
+          char *last_line = NULL;
+          char *stop;
+          idx_t i, n;
+
+          /* Find how many lines the numeric addresses allow to skip,
+             and which regex addresses come into play; then look for
+             the next line that one of those could match.  */
+          for (n = 0; n < skip_cmds_count; n++)
+            {
+              struct sed_cmd *cmd = skip_cmds[n].cmd;
+              intmax_t first, last;
+
+              if (cmd->a1->addr_type == ADDR_IS_REGEX)
+                {
+                  regex = true;
+                  continue;
+                }
+
+              if (cmd->a1->addr_type == ADDR_IS_LAST)
+                {
+                  /* Only the line that ends the look-ahead can be the
+                     last one; if the look-ahead does not end with a
+                     delimiter, that is the incomplete line after LIM.  */
+                  if (!last_line)
+                    {
+                      if (lim + 1 == beg + buffer.length)
+                        {
+                          last_line = memrchr (beg, buffer_delimiter,
+                                               lim - beg);
+                          last_line = last_line ? last_line + 1 : beg;
+                        }
+                      else
+                        last_line = lim + 1;
+                    }
+
+                  /* '$!d' deletes all the lines before it.  */
+                  if (cmd->cmd == 'd' && cmd->addr_bang)
+                    {
+                      drop = true;
+                      break;
+                    }
+                  continue;
+                }
+
+              numeric_address_span (cmd, l, &first, &last);
+              if (first > l)
+                span = MIN (span, first - l);
+              else if (cmd->cmd == 'd')
+                {
+                  span = MIN (span, last - l + 1);
+                  drop = true;
+                  break;
+                }
+              else
+                return;
+            }
+
+          /* Lines dropped because of their number need not even be
+             read if the input is indexed.  */
+          if (drop && !regex && span < INTMAX_MAX && line_index_file
+              && line_index_jump (input, l - 1 + span))
+            continue;
+
+          stop = last_line ? last_line : lim + 1;
+          for (i = 0; i < n; i++)
+            {
+              struct skip_cmd *sc = &skip_cmds[i];
+
+              if (sc->cmd->a1->addr_type != ADDR_IS_REGEX)
+                continue;
+
+              if (sc->generation != buffer_generation || sc->next < beg)
+                {
+                  sc->next = skip_regex_next_line (sc->cmd->a1->addr_regex,
+                                                   beg, lim);
+                  sc->generation = buffer_generation;
+                }
+              if (sc->next < stop)
+                stop = sc->next;
+            }
+
+          /* Only count as many lines as can be skipped anyway.  */
+          if (span < INTMAX_MAX)
+            stop = skip_n_lines (beg, stop, span);
+
+          if (stop != beg)
+            {
+              if (skip_counts_lines
+                  && (ckd_add (&input->line_number, input->line_number,
+                               count_delimiters (beg, stop - beg))
+                      || input->line_number == INTMAX_MAX))
+                bad_prog ("line number overflow");
+
+              if (!drop)
+                {
+                  output_missing_newline (&output_file);
+                  ck_fwrite (beg, 1, stop - beg, output_file.fp);
+                }
+
+              buffer.active = stop;
+              buffer.length -= stop - beg;
+            }
+
+          if (stop <= lim)
+            return;
+        }
+
+      if (!read_input_block (input))
+        return;
+    }
+}
+
+/* Return true if no command with a visible effect can run again on the
+   current file or, without -s, on the rest of the input; see
+   compute_end_line in compile.c.  */
+static bool
+program_finished_p (struct vector *the_program, struct input *input)
+{
+  idx_t i;
+
+  if (the_program->end_line < 0
+      || input->line_number < the_program->end_line)
+    return false;
+
+  for (i = 0; i < the_program->n_end_ranges; i++)
+    if (the_program->v[the_program->end_ranges[i]].range_state
+        != RANGE_CLOSED)
+      return false;
+
+  return true;
+}
+
+/* Stop reading the current file and, without -s, the rest of the
+   input.  The remaining files are still opened, so that those that
+   cannot be read are reported as usual.  */
+static void
+discard_input (struct input *input)
+{
+  if (append_head)
+    dump_append_queue ();
+
+  closedown (input);
+  if (!separate_files)
+    while (*input->file_list)
+      {
+        open_next_file (*input->file_list++, input);
+        closedown (input);
+      }
+}
+
+/* Return true if the program has an r or R command reading standard
+   input.  The main input must then not read ahead of what it uses, or
+   the lines it buffered would never reach that command.  */
+static bool
+reads_stdin_p (struct vector *the_program)
+{
+  idx_t i;
+
+  for (i = 0; i < the_program->v_length; i++)
+    {
+      struct sed_cmd *cmd = &the_program->v[i];
+      if (cmd->cmd == 'R' && cmd->x.inf->fp == stdin)
+        return true;
+      if (cmd->cmd == 'r' && STREQ (cmd->x.readcmd.fname, "/dev/stdin"))
+        return true;
+    }
+  return false;
+}
+
 /* Apply the compiled script to all the named files. */
 int
 process_files (struct vector *the_program, char **argv)
@@ -1680,10 +2517,24 @@ process_files (struct vector *the_program, char **argv)
   input.line_number = 0;
   input.read_fn = read_always_fail;
   input.fp = NULL;
+  /* Where files are opened in text mode unless -b is given, stdio
+     translates their CR-LFs, and read_input_block would bypass it.  */
+  input.no_buffering = (unbuffered || reads_stdin_p (the_program)
+                        || (O_BINARY && !STREQ (read_mode, "rb")));
+  input.eof = false;
+  input.start_offset = -1;
+  current_input = &input;
+
+  setup_line_skipping (the_program);
 
   status = EXIT_SUCCESS;
-  while (read_pattern_space (&input, the_program, false))
+  for (;;)
     {
+      if (skip_cmds)
+        skip_lines (&input);
+      if (!read_pattern_space (&input, the_program, false))
+        break;
+
       if (debug)
         {
           debug_print_input (&input);
@@ -1695,6 +2546,9 @@ process_files (struct vector *the_program, char **argv)
         status = EXIT_SUCCESS;
       else
         break;
+
+      if (program_finished_p (the_program, &input))
+        discard_input (&input);
     }
   closedown (&input);
 
@@ -1709,6 +2563,8 @@ process_files (struct vector *the_program, char **argv)
   free (hold.text);
   free (line.text);
   free (s_accum.text);
+  free (skip_cmds);
+  free (line_index);
 #endif /* lint */
 
   if (input.bad_count)
@@ -18,10 +18,12 @@ bin_PROGRAMS += sed/sed
 localedir = $(datadir)/locale
 
 sed_sed_SOURCES =	\
+  sed/backref.c		\
   sed/compile.c		\
   sed/debug.c		\
   sed/execute.c		\
   sed/mbcs.c		\
+  sed/onepass.c		\
   sed/regexp.c		\
   sed/sed.c		\
   sed/utils.c
@@ -0,0 +1,523 @@
+/*  GNU SED, a batch stream editor.
+    Copyright (C) 2024 Free Software Foundation, Inc.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3, or (at your option)
+    any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; If not, see <https://www.gnu.org/licenses/>. */
+
+/* A matcher for the regular expressions that can be matched in one
+   pass, computing the same registers as re_search in linear time.
+
+   The patterns handled are sequences of single-character atoms (plain
+   or escaped characters, '.', bracket expressions), each optionally
+   followed by '*' (or, with -E, '+' or '?'), with groups that are
+   neither nested nor repeated, and optionally anchored by a leading
+   '^' and a trailing '$'.  Such a pattern is a sequence of elements,
+   and it is "one-pass" if, at every point of a match, the next byte
+   tells which element it belongs to.  The text matched from a given
+   start then follows a single path, the longest match is the last
+   point of that path where the pattern can end, and the position of
+   each group on that path is the only possible one; so POSIX
+   leftmost-longest rules give the same registers as this matcher.
+
+   All the start positions are tried in parallel as in a Pike VM, with
+   one thread per state: the thread with the earliest start wins when
+   two reach the same state, since they then have the same future.  */
+
+#include "sed.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "xalloc.h"
+
+struct onepass_thread {
+  idx_t start;
+  int state;
+};
+
+struct onepass {
+  int n_elts;
+  int n_states;
+  idx_t nsub;
+
+  /* The states are numbered from 0 (before the first element) to
+     N_ELTS: in state S, element S - 1 was the last one to match a byte.
+     NEXT[S * 256 + C] is the state reached from S on byte C, or -1.
+     ACCEPT[S] is true if the pattern can end in state S.  */
+  int *next;
+  bool *accept;
+
+  /* Group G starts before element GROUP_OPEN[G], and ends before
+     element GROUP_CLOSE[G] (or at the end if that is N_ELTS).  */
+  int *group_open;
+  int *group_close;
+
+  bool anchor_start;
+  bool anchor_end;
+
+  /* Scratch space for onepass_search: the current and next threads,
+     in order of priority, and their registers.  */
+  struct onepass_thread *clist, *nlist;
+  idx_t *ccaps, *ncaps, *best_caps;
+  bool *taken;
+};
+
+/* Add to SET the bytes of the character class NAME, of length LEN.
+   Return false if NAME is not known.  */
+static bool
+add_char_class (unsigned char *set, const char *name, idx_t len)
+{
+  static char const *const names[] = {
+    "alpha", "upper", "lower", "digit", "xdigit", "space",
+    "print", "punct", "graph", "cntrl", "blank", "alnum"
+  };
+  int k, c;
+
+  for (k = 0; k < sizeof names / sizeof *names; k++)
+    if (strlen (names[k]) == len && memcmp (names[k], name, len) == 0)
+      break;
+
+  for (c = 0; c < 256; c++)
+    {
+      bool in;
+
+      switch (k)
+        {
+        case 0: in = isalpha (c); break;
+        case 1: in = isupper (c); break;
+        case 2: in = islower (c); break;
+        case 3: in = isdigit (c); break;
+        case 4: in = isxdigit (c); break;
+        case 5: in = isspace (c); break;
+        case 6: in = isprint (c); break;
+        case 7: in = ispunct (c); break;
+        case 8: in = isgraph (c); break;
+        case 9: in = iscntrl (c); break;
+        case 10: in = isblank (c); break;
+        case 11: in = isalnum (c); break;
+        default: return false;
+        }
+      if (in)
+        set[c] = 1;
+    }
+
+  return true;
+}
+
+/* Parse the bracket expression at RE[*I], which is '[', into SET.
+   Return false if it uses something this matcher does not handle.  */
+static bool
+parse_bracket (const char *re, idx_t sz, idx_t *i, unsigned char *set)
+{
+  idx_t j = *i + 1;
+  bool negate = false;
+  int c;
+
+  if (j < sz && re[j] == '^')
+    negate = true, j++;
+  if (j < sz && re[j] == ']')
+    set[']'] = 1, j++;
+
+  while (j < sz && re[j] != ']')
+    {
+      unsigned char lo = re[j], hi;
+
+      if (lo == '[' && j + 1 < sz && re[j + 1] == ':')
+        {
+          idx_t name = j + 2;
+          for (j = name; j + 1 < sz && !(re[j] == ':' && re[j + 1] == ']');
+               j++)
+            continue;
+          if (j + 1 >= sz || !add_char_class (set, re + name, j - name))
+            return false;
+          j += 2;
+          continue;
+        }
+
+      /* Collating symbols and equivalence classes.  */
+      if (lo == '[' && j + 1 < sz && (re[j + 1] == '.' || re[j + 1] == '='))
+        return false;
+
+      if (j + 2 < sz && re[j + 1] == '-' && re[j + 2] != ']')
+        {
+          hi = re[j + 2];
+          if (hi == '[' || hi < lo)
+            return false;
+          j += 3;
+        }
+      else
+        hi = lo, j++;
+
+      for (c = lo; c <= hi; c++)
+        set[c] = 1;
+    }
+
+  if (j == sz)
+    return false;
+
+  if (negate)
+    for (c = 0; c < 256; c++)
+      set[c] = !set[c];
+
+  *i = j + 1;
+  return true;
+}
+
+/* Return true if RE[I] starts a repetition operator.  */
+static bool
+quantifier_p (const char *re, idx_t sz, idx_t i, bool extended)
+{
+  if (i == sz)
+    return false;
+  if (re[i] == '*')
+    return true;
+  if (extended)
+    return re[i] == '+' || re[i] == '?' || re[i] == '{';
+  return (re[i] == '\\' && i + 1 < sz && re[i + 1]
+          && strchr ("{+?", re[i + 1]));
+}
+
+/* Compute the transitions of OP, and return false if some byte can
+   be matched by two elements at the same point.  */
+static bool
+build_onepass_states (struct onepass *op, struct simple_elt *elts)
+{
+  int s, k, c;
+
+  op->n_states = op->n_elts + 1;
+  op->next = XNMALLOC (op->n_states * 256, int);
+  op->accept = XNMALLOC (op->n_states, bool);
+
+  for (s = 0; s < op->n_states; s++)
+    {
+      int *next = op->next + s * 256;
+
+      for (c = 0; c < 256; c++)
+        next[c] = -1;
+
+      /* Element S - 1 may match again if it is repeated, and then any
+         of the following elements up to the first one that is not
+         optional.  */
+      for (k = s > 0 && elts[s - 1].repeat ? s - 1 : s; k < op->n_elts; k++)
+        {
+          for (c = 0; c < 256; c++)
+            if (elts[k].set[c])
+              {
+                if (next[c] >= 0)
+                  return false;
+                next[c] = k + 1;
+              }
+          if (k >= s && !elts[k].optional)
+            break;
+        }
+
+      op->accept[s] = k == op->n_elts;
+    }
+
+  return true;
+}
+
+/* Parse the normalized pattern RE of length SZ, with NSUB groups and
+   EXTENDED telling whether it is an ERE, into at most
+   SIMPLE_REGEX_MAX_ELTS elements stored in ELTS.  Group G starts
+   before element GROUP_OPEN[G] and ends before element GROUP_CLOSE[G].
+   Back-references to groups closed before them are only accepted if
+   BACKREFS.  Set *ANCHOR_START and *ANCHOR_END if RE starts with '^'
+   and ends with '$'.  Return the number of elements, or -1 if RE is
+   not in the class described above.  */
+int
+simple_regex_parse (const char *re, idx_t sz, bool extended, idx_t nsub,
+                    bool backrefs, struct simple_elt *elts,
+                    int *group_open, int *group_close,
+                    bool *anchor_start, bool *anchor_end)
+{
+  idx_t i = 0, n_groups = 0;
+  int n_elts = 0, open_group = -1;
+
+  *anchor_start = *anchor_end = false;
+  if (i < sz && re[i] == '^')
+    *anchor_start = true, i++;
+
+  while (i < sz)
+    {
+      unsigned char c = re[i];
+      struct simple_elt *elt;
+
+      if (c == '$' && i + 1 == sz)
+        {
+          *anchor_end = true;
+          break;
+        }
+
+      /* Group delimiters, which cannot be repeated.  */
+      if (extended ? c == '(' || c == ')'
+          : c == '\\' && i + 1 < sz && (re[i + 1] == '(' || re[i + 1] == ')'))
+        {
+          bool open = extended ? c == '(' : re[i + 1] == '(';
+
+          i += extended ? 1 : 2;
+          if (open)
+            {
+              if (open_group >= 0 || n_groups == nsub)
+                return -1;
+              open_group = n_groups++;
+              group_open[open_group] = n_elts;
+            }
+          else
+            {
+              if (open_group < 0 || quantifier_p (re, sz, i, extended))
+                return -1;
+              group_close[open_group] = n_elts;
+              open_group = -1;
+            }
+          continue;
+        }
+
+      if (n_elts + 2 > SIMPLE_REGEX_MAX_ELTS)
+        return -1;
+      elt = &elts[n_elts++];
+      memset (elt, 0, sizeof *elt);
+
+      if (c == '[')
+        {
+          if (!parse_bracket (re, sz, &i, elt->set))
+            return -1;
+        }
+      else if (c == '.')
+        {
+          memset (elt->set, 1, sizeof elt->set);
+          i++;
+        }
+      else if (c == '\\' && backrefs && i + 1 < sz
+               && '1' <= re[i + 1] && re[i + 1] <= '9')
+        {
+          /* A back-reference, to a group closed before it.  */
+          elt->ref = re[i + 1] - '0';
+          if (n_groups < elt->ref || open_group == elt->ref - 1)
+            return -1;
+          i += 2;
+          if (quantifier_p (re, sz, i, extended))
+            return -1;
+          continue;
+        }
+      else if (c == '\\')
+        {
+          if (i + 1 == sz || !regex_special_char_p (re[i + 1], extended))
+            return -1;
+          elt->set[(unsigned char) re[i + 1]] = 1;
+          i += 2;
+        }
+      else if (regex_special_char_p (c, extended))
+        return -1;
+      else
+        {
+          elt->set[c] = 1;
+          i++;
+        }
+
+      if (quantifier_p (re, sz, i, extended))
+        {
+          if (re[i] == '*')
+            elt->optional = elt->repeat = true;
+          else if (re[i] == '?')
+            elt->optional = true;
+          else if (re[i] == '+')
+            {
+              /* X+ is X followed by X*.  */
+              elts[n_elts] = *elt;
+              elt = &elts[n_elts++];
+              elt->optional = elt->repeat = true;
+            }
+          else
+            return -1;
+          i++;
+          if (quantifier_p (re, sz, i, extended))
+            return -1;
+        }
+    }
+
+  if (open_group >= 0 || n_groups != nsub)
+    return -1;
+  return n_elts;
+}
+
+/* Return a matcher for the normalized pattern RE of length SZ with
+   NSUB groups, or NULL if RE is not in the class described above.
+   EXTENDED tells whether RE is an ERE.  */
+struct onepass *
+onepass_compile (const char *re, idx_t sz, bool extended, idx_t nsub)
+{
+  struct onepass *op = XZALLOC (struct onepass);
+  struct simple_elt *elts = XNMALLOC (SIMPLE_REGEX_MAX_ELTS,
+                                      struct simple_elt);
+
+  op->group_open = XNMALLOC (nsub + 1, int);
+  op->group_close = XNMALLOC (nsub + 1, int);
+  op->n_elts = simple_regex_parse (re, sz, extended, nsub, false, elts,
+                                   op->group_open, op->group_close,
+                                   &op->anchor_start, &op->anchor_end);
+  if (op->n_elts < 0 || !build_onepass_states (op, elts))
+    goto fail;
+
+  free (elts);
+  op->nsub = nsub;
+  op->clist = XNMALLOC (op->n_states, struct onepass_thread);
+  op->nlist = XNMALLOC (op->n_states, struct onepass_thread);
+  op->ccaps = XNMALLOC (op->n_states * 2 * (nsub + 1), idx_t);
+  op->ncaps = XNMALLOC (op->n_states * 2 * (nsub + 1), idx_t);
+  op->best_caps = XNMALLOC (2 * (nsub + 1), idx_t);
+  op->taken = XNMALLOC (op->n_states, bool);
+  return op;
+
+ fail:
+  free (elts);
+  onepass_free (op);
+  return NULL;
+}
+
+void
+onepass_free (struct onepass *op)
+{
+  if (!op)
+    return;
+  free (op->next);
+  free (op->accept);
+  free (op->group_open);
+  free (op->group_close);
+  free (op->clist);
+  free (op->nlist);
+  free (op->ccaps);
+  free (op->ncaps);
+  free (op->best_caps);
+  free (op->taken);
+  free (op);
+}
+
+/* Record in CAPS the groups that start or end between states FROM and
+   TO (excluding FROM itself), at offset POS.  */
+static void
+cross_groups (struct onepass *op, idx_t *caps, int from, int to, idx_t pos)
+{
+  idx_t g;
+
+  for (g = 0; g < op->nsub; g++)
+    {
+      if (from < op->group_open[g] + 1 && op->group_open[g] + 1 <= to)
+        caps[2 * g] = pos;
+      if (from < op->group_close[g] + 1 && op->group_close[g] + 1 <= to)
+        caps[2 * g + 1] = pos;
+    }
+}
+
+/* Search BUF, of length BUFLEN, for the leftmost-longest match of OP
+   starting between START and START + RANGE, and store its registers
+   in REGS unless it is NULL.  Return the start of the match, or -1 if
+   there is none.  */
+idx_t
+onepass_search (struct onepass *op, const char *buf, idx_t buflen,
+                idx_t start, idx_t range, struct match_regs *regs)
+{
+  idx_t ncaps = 2 * op->nsub;
+  idx_t best_start = -1, best_end = -1;
+  idx_t nc = 0, pos, g;
+
+  if (op->anchor_start && start > 0)
+    return -1;
+
+  for (pos = start; ; pos++)
+    {
+      idx_t nn = 0, i;
+
+      /* Start a new thread, with the lowest priority.  No transition
+         leads back to state 0, so it is always free.  */
+      if (best_start < 0 && pos - start <= range
+          && (!op->anchor_start || pos == 0))
+        {
+          op->clist[nc].start = pos;
+          op->clist[nc].state = 0;
+          for (g = 0; g < ncaps; g++)
+            op->ccaps[nc * ncaps + g] = -1;
+          nc++;
+        }
+
+      /* The first thread that can end here has the earliest start,
+         and those after it can no longer win.  */
+      if (!op->anchor_end || pos == buflen)
+        for (i = 0; i < nc; i++)
+          if (op->accept[op->clist[i].state])
+            {
+              best_start = op->clist[i].start;
+              best_end = pos;
+              memcpy (op->best_caps, op->ccaps + i * ncaps,
+                      ncaps * sizeof *op->best_caps);
+              cross_groups (op, op->best_caps, op->clist[i].state,
+                            op->n_states, pos);
+              nc = i + 1;
+              break;
+            }
+
+      if (pos == buflen
+          || (nc == 0 && (best_start >= 0 || pos - start >= range
+                          || op->anchor_start)))
+        break;
+
+      memset (op->taken, 0, op->n_states * sizeof *op->taken);
+      for (i = 0; i < nc; i++)
+        {
+          struct onepass_thread *t = &op->clist[i];
+          int to = op->next[t->state * 256 + (unsigned char) buf[pos]];
+
+          if (to < 0 || op->taken[to])
+            continue;
+          op->taken[to] = true;
+          op->nlist[nn].start = t->start;
+          op->nlist[nn].state = to;
+          memcpy (op->ncaps + nn * ncaps, op->ccaps + i * ncaps,
+                  ncaps * sizeof *op->ncaps);
+          cross_groups (op, op->ncaps + nn * ncaps, t->state, to, pos);
+          nn++;
+        }
+
+      {
+        struct onepass_thread *tl = op->clist;
+        idx_t *tc = op->ccaps;
+        op->clist = op->nlist, op->nlist = tl;
+        op->ccaps = op->ncaps, op->ncaps = tc;
+        nc = nn;
+      }
+    }
+
+  if (best_start < 0 || !regs)
+    return best_start;
+
+  if (regs->num_regs < op->nsub + 1)
+    {
+      regs->start = xnrealloc (regs->start, op->nsub + 1,
+                               sizeof *regs->start);
+      regs->end = xnrealloc (regs->end, op->nsub + 1, sizeof *regs->end);
+      regs->num_regs = op->nsub + 1;
+    }
+
+  regs->start[0] = best_start;
+  regs->end[0] = best_end;
+  for (g = 0; g < op->nsub; g++)
+    {
+      regs->start[g + 1] = op->best_caps[2 * g];
+      regs->end[g + 1] = op->best_caps[2 * g + 1];
+    }
+  for (g = op->nsub + 1; g < regs->num_regs; g++)
+    regs->start[g] = regs->end[g] = -1;
+
+  return best_start;
+}
@@ -23,6 +23,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "gethrxtime.h"
+#include "memchr2.h"
+#include "minmax.h"
 #include "xalloc.h"
 
 extern bool use_extended_syntax_p;
@@ -41,13 +44,103 @@ dfawarn (char const *mesg)
 }
 
 
-static void
-compile_regex_1 (struct regex *new_regex, int needed_sub)
+/* Return the ASCII letter C in lower case, or C itself if it is not
+   an ASCII letter.  */
+static unsigned char
+ascii_tolower (unsigned char c)
 {
-  const char *error;
-  int syntax = ((extended_regexp_flags & REG_EXTENDED)
-                 ? RE_SYNTAX_POSIX_EXTENDED
-                 : RE_SYNTAX_POSIX_BASIC);
+  return 'A' <= c && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+/* Return the ASCII letter C in the other case, or C itself if it is
+   not an ASCII letter.  */
+static unsigned char
+ascii_other_case (unsigned char c)
+{
+  return 'a' <= c && c <= 'z' ? c - 'a' + 'A' : ascii_tolower (c);
+}
+
+/* Return true if, ignoring case, the character C matches just itself
+   and the ASCII letter that is C in the other case, if any; in which
+   case comparing bytes with ascii_tolower agrees with the matchers.
+   In many locales, some letters also match non-ASCII characters:
+   's' matches LATIN SMALL LETTER LONG S in UTF-8 locales, and 'i'
+   matches LATIN CAPITAL LETTER I WITH DOT ABOVE in Turkish ones.  */
+static bool
+ascii_fold_p (unsigned char c)
+{
+  unsigned char other = ascii_other_case (c);
+  int b;
+
+  if (localeinfo.multibyte)
+    {
+      wchar_t folded[CASE_FOLDED_BUFSIZE];
+      int n;
+
+      if (c >= 0x80)
+        return false;
+      n = case_folded_counterparts (c, folded);
+      return n == (other != c) && (n == 0 || folded[0] == other);
+    }
+
+  for (b = 0; b < 256; b++)
+    if (b != c
+        && (b == other) != (toupper (b) == toupper (c)
+                            || tolower (b) == tolower (c)))
+      return false;
+  return true;
+}
+
+/* Like memmem, but the ASCII letters in HAYSTACK of length HAYSTACK_LEN
+   match NEEDLE of length NEEDLE_LEN, which is in lower case, in either
+   case.  The candidates are found with memchr2 on a byte of NEEDLE
+   that is not a letter, if any, since those tend to be rarer.  */
+static const char *
+memmem_icase (const char *haystack, idx_t haystack_len,
+              const char *needle, idx_t needle_len)
+{
+  const char *p, *lim;
+  unsigned char c;
+  idx_t anchor, i;
+
+  if (needle_len == 0)
+    return haystack;
+  if (haystack_len < needle_len)
+    return NULL;
+
+  for (anchor = 0; anchor < needle_len; anchor++)
+    if (ascii_other_case (needle[anchor])
+        == (unsigned char) needle[anchor])
+      break;
+  if (anchor == needle_len)
+    anchor = 0;
+  c = needle[anchor];
+
+  p = haystack + anchor;
+  lim = haystack + haystack_len - needle_len + anchor + 1;
+  while ((p = memchr2 (p, c, ascii_other_case (c), lim - p)))
+    {
+      const char *start = p - anchor;
+
+      for (i = 0; i < needle_len; i++)
+        if (ascii_tolower (start[i]) != (unsigned char) needle[i])
+          break;
+      if (i == needle_len)
+        return start;
+      p++;
+    }
+
+  return NULL;
+}
+
+/* Return the syntax bits for a regex with FLAGS, without those that
+   depend on the registers needed or on the M modifier.  */
+static reg_syntax_t
+regex_syntax (int flags)
+{
+  reg_syntax_t syntax = ((extended_regexp_flags & REG_EXTENDED)
+                         ? RE_SYNTAX_POSIX_EXTENDED
+                         : RE_SYNTAX_POSIX_BASIC);
 
   syntax &= ~RE_DOT_NOT_NULL;
   syntax |= RE_NO_POSIX_BACKTRACKING;
@@ -67,10 +160,18 @@ compile_regex_1 (struct regex *new_regex, int needed_sub)
       break;
     }
 
-  if (new_regex->flags & REG_ICASE)
+  if (flags & REG_ICASE)
     syntax |= RE_ICASE;
-  else
-    new_regex->pattern.fastmap = malloc (1 << (sizeof (char) * 8));
+  return syntax;
+}
+
+static void
+compile_regex_1 (struct regex *new_regex, int needed_sub)
+{
+  const char *error;
+  reg_syntax_t syntax = regex_syntax (new_regex->flags);
+
+  new_regex->pattern.fastmap = malloc (1 << (sizeof (char) * 8));
   syntax |= needed_sub ? 0 : RE_NO_SUB;
 
   /* If REG_NEWLINE is set, newlines are treated differently.  */
@@ -112,7 +213,38 @@ compile_regex_1 (struct regex *new_regex, int needed_sub)
   int dfaopts = buffer_delimiter == '\n' ? 0 : DFA_EOL_NUL;
   new_regex->dfa = dfaalloc ();
   dfasyntax (new_regex->dfa, &localeinfo, syntax, dfaopts);
-  dfacomp (new_regex->re, new_regex->sz, new_regex->dfa, 1);
+  dfaparse (new_regex->re, new_regex->sz, new_regex->dfa);
+
+  /* Remember a string that every match must contain, so that
+     match_regex can rule out most buffers with a substring search.
+     With I, the string is kept in lower case for memmem_icase, if
+     that finds it wherever the matchers would.  */
+  if (!new_regex->must)
+    {
+      struct dfamust *dm = dfamust (new_regex->dfa);
+      if (dm)
+        {
+          idx_t len = strlen (dm->must), i;
+          char *must = xmemdup (dm->must, len);
+
+          dfamustfree (dm);
+          if (new_regex->flags & REG_ICASE)
+            for (i = 0; i < len; i++)
+              {
+                if (!ascii_fold_p (must[i]))
+                  {
+                    free (must);
+                    must = NULL;
+                    break;
+                  }
+                must[i] = ascii_tolower (must[i]);
+              }
+          new_regex->must = must;
+          new_regex->must_len = must ? len : 0;
+        }
+    }
+
+  dfacomp (NULL, 0, new_regex->dfa, 1);
 
   /* The patterns which consist of only ^ or $ often appear in
      substitution, but regex and dfa are not good at them, as regex does
@@ -127,6 +259,558 @@ compile_regex_1 (struct regex *new_regex, int needed_sub)
     }
 }
 
+/* Return true if C has a special meaning in a regular expression,
+   in which case it stands for itself when preceded by a backslash.  */
+bool
+regex_special_char_p (unsigned char c, bool extended)
+{
+  switch (c)
+    {
+    case '.': case '[': case '\\': case '*': case '^': case '$':
+      return true;
+    case '+': case '?': case '(': case ')': case '{': case '}': case '|':
+      return extended;
+    default:
+      return false;
+    }
+}
+
+/* The most alternatives that compile_literal accepts.  Each one costs
+   a memmem call, so beyond that the DFA, which looks at each byte once,
+   is faster.  */
+#define LITERAL_ALTERNATIVES_MAX 8
+
+/* If REGEX can only match one fixed string, store it in REGEX->literal
+   so that match_regex can look for it with memmem, or with I, in lower
+   case for memmem_icase.  Likewise, if it is
+   an alternation of fixed strings such as 'GET\|POST', possibly as the
+   only group between two fixed strings as in 'a\(b\|cd\)e', store the
+   strings it can match in REGEX->alternatives.  Multibyte locales
+   other than UTF-8 are left alone, since a byte search could match in
+   the middle of a character; so are case-insensitive patterns with
+   characters that ascii_fold_p rejects, case-insensitive alternations
+   of letters, and with M and -z, patterns spanning lines.  */
+static void
+compile_literal (struct regex *regex)
+{
+  bool extended = (extended_regexp_flags & REG_EXTENDED) != 0;
+  bool alternation = extended || posixicity != POSIXLY_BASIC;
+  mbstate_t cur_stat = { 0, };
+  char *literal, *q;
+  bool folded = false;
+  idx_t i;
+
+  /* The pieces of the pattern: PIECE[K] is where piece K starts in
+     LITERAL.  Without a group, each piece is an alternative; with one,
+     the first piece is the text before it, and the last the text
+     after it.  */
+  idx_t piece[LITERAL_ALTERNATIVES_MAX + 3];
+  int n_pieces = 1;
+  enum { BEFORE_GROUP, IN_GROUP, AFTER_GROUP } where = BEFORE_GROUP;
+
+  if (mb_cur_max > 1 && !is_utf8)
+    return;
+
+  literal = q = xmalloc (regex->sz);
+  piece[0] = 0;
+  for (i = 0; i < regex->sz; i++)
+    {
+      unsigned char c = regex->re[i];
+      size_t n = MBRLEN (regex->re + i, regex->sz - i, &cur_stat);
+      bool escaped = false;
+
+      if (n != 1)
+        {
+          if (n == (size_t) -1 || n == (size_t) -2 || n == 0
+              || (regex->flags & REG_ICASE))
+            goto not_literal;
+          q = mempcpy (q, regex->re + i, n);
+          i += n - 1;
+          continue;
+        }
+
+      if (c == '\\')
+        {
+          if (i + 1 == regex->sz)
+            goto not_literal;
+          c = regex->re[++i];
+          escaped = true;
+        }
+
+      if (escaped != extended && (c == '(' || c == ')' || c == '|'))
+        {
+          /* Every alternative, and the text in the group, must be
+             nonempty.  */
+          bool empty = q - literal == piece[n_pieces - 1];
+
+          if (c == '(')
+            {
+              if (where != BEFORE_GROUP || n_pieces > 1)
+                goto not_literal;
+              where = IN_GROUP;
+            }
+          else if (empty || (c == ')' ? where != IN_GROUP
+                             : !alternation || where == AFTER_GROUP))
+            goto not_literal;
+          else if (c == ')')
+            where = AFTER_GROUP;
+
+          if (n_pieces == LITERAL_ALTERNATIVES_MAX + 2)
+            goto not_literal;
+          piece[n_pieces++] = q - literal;
+          continue;
+        }
+
+      if (escaped != regex_special_char_p (c, extended))
+        goto not_literal;
+
+      if ((regex->flags & REG_NEWLINE) && buffer_delimiter != '\n'
+          && c == buffer_delimiter)
+        goto not_literal;
+
+      if (regex->flags & REG_ICASE)
+        {
+          if (!ascii_fold_p (c))
+            goto not_literal;
+          folded |= ascii_other_case (c) != c;
+          c = ascii_tolower (c);
+        }
+
+      *q++ = c;
+    }
+
+  if (where == IN_GROUP
+      || (where == BEFORE_GROUP && q - literal == piece[n_pieces - 1]))
+    goto not_literal;
+  piece[n_pieces] = q - literal;
+
+  if (where == BEFORE_GROUP && n_pieces == 1)
+    {
+      regex->literal = literal;
+      regex->literal_len = q - literal;
+      return;
+    }
+
+  /* Alternatives are only looked for in the case given.  */
+  if (folded)
+    goto not_literal;
+
+  /* Make each alternative a whole string, with the text around the
+     group if any.  */
+  idx_t first = 0, last = n_pieces - 1;
+  idx_t prefix = 0, suffix = 0;
+  if (where == AFTER_GROUP)
+    {
+      first = 1;
+      last = n_pieces - 2;
+      prefix = piece[1];
+      suffix = piece[n_pieces] - piece[n_pieces - 1];
+    }
+  if (last - first >= LITERAL_ALTERNATIVES_MAX)
+    goto not_literal;
+
+  regex->n_alternatives = last - first + 1;
+  regex->alternatives = XNMALLOC (regex->n_alternatives, char *);
+  regex->alternative_len = XNMALLOC (regex->n_alternatives, idx_t);
+  regex->alternative_prefix = prefix;
+  regex->alternative_suffix = suffix;
+  for (idx_t k = first; k <= last; k++)
+    {
+      idx_t len = piece[k + 1] - piece[k];
+      char *alt = xmalloc (prefix + len + suffix);
+
+      memcpy (alt, literal, prefix);
+      memcpy (alt + prefix, literal + piece[k], len);
+      memcpy (alt + prefix + len, literal + piece[n_pieces - 1], suffix);
+      regex->alternatives[k - first] = alt;
+      regex->alternative_len[k - first] = prefix + len + suffix;
+    }
+  free (literal);
+  return;
+
+ not_literal:
+  free (literal);
+}
+
+/* Return true if the normalized pattern RE of length SZ may contain
+   '^', '$' or one of \`, \', \<, \>, \b and \B.  Bracket expressions
+   are skipped; in multibyte locales other than UTF-8, a byte that looks
+   like a backslash might end a character, so the answer is yes.  */
+static bool
+needs_context_p (const char *re, idx_t sz)
+{
+  idx_t i;
+
+  if (mb_cur_max > 1 && !is_utf8)
+    return true;
+
+  for (i = 0; i < sz; i++)
+    switch (re[i])
+      {
+      case '^':
+      case '$':
+        return true;
+
+      case '\\':
+        if (++i < sz && re[i] && strchr ("`'<>bB", re[i]))
+          return true;
+        break;
+
+      case '[':
+        if (i + 1 < sz && re[i + 1] == '^')
+          i++;
+        if (i + 1 < sz && re[i + 1] == ']')
+          i++;
+        for (i++; i < sz && re[i] != ']'; i++)
+          if (re[i] == '[' && i + 1 < sz
+              && (re[i + 1] == ':' || re[i + 1] == '.' || re[i + 1] == '='))
+            {
+              char delim = re[i + 1];
+              for (i += 2; i + 1 < sz && !(re[i] == delim && re[i + 1] == ']');
+                   i++)
+                continue;
+              i++;
+            }
+        break;
+      }
+
+  return false;
+}
+
+/* Return the most bytes that a match of REGEX can span, or -1 if that
+   is not bounded or not known.  Only fixed strings, alternations of
+   them and the patterns of simple_regex_parse without '*' or '+' are
+   considered, and multibyte locales other than UTF-8 are left alone,
+   since a search cannot start at any byte there.  */
+static idx_t
+max_match_length (const struct regex *regex)
+{
+  struct simple_elt *elts;
+  int *groups;
+  bool anchor_start, anchor_end;
+  idx_t len = -1, i;
+  int n;
+
+  if (regex->begline || regex->endline || (mb_cur_max > 1 && !is_utf8))
+    return -1;
+
+  if (regex->literal)
+    return regex->literal_len;
+
+  if (regex->alternatives)
+    {
+      for (i = 0; i < regex->n_alternatives; i++)
+        len = MAX (len, regex->alternative_len[i]);
+      return len;
+    }
+
+  elts = XNMALLOC (SIMPLE_REGEX_MAX_ELTS, struct simple_elt);
+  groups = XNMALLOC (2 * (regex->pattern.re_nsub + 1), int);
+  n = simple_regex_parse (regex->re, regex->sz,
+                          (extended_regexp_flags & REG_EXTENDED) != 0,
+                          regex->pattern.re_nsub, false, elts, groups,
+                          groups + regex->pattern.re_nsub + 1,
+                          &anchor_start, &anchor_end);
+  if (n >= 0)
+    {
+      len = n * (idx_t) mb_cur_max;
+      for (i = 0; i < n; i++)
+        if (elts[i].repeat)
+          len = -1;
+    }
+  free (elts);
+  free (groups);
+  return len;
+}
+
+/* REGEX needs registers: use a matcher that computes them in linear
+   time if the pattern allows.  It works on bytes, and only knows the
+   character classes and ranges of simple locales.  */
+static void
+compile_onepass (struct regex *regex)
+{
+  if (regex->onepass_tried)
+    return;
+  regex->onepass_tried = true;
+
+  if (!regex->literal && !regex->alternatives
+      && !regex->begline && !regex->endline
+      && localeinfo.simple && !(regex->flags & (REG_ICASE | REG_NEWLINE)))
+    regex->onepass = onepass_compile (regex->re, regex->sz,
+                                      (extended_regexp_flags
+                                       & REG_EXTENDED) != 0,
+                                      regex->pattern.re_nsub);
+}
+
+/* The most elements that the bounded repetitions of a regex may
+   expand to before --strict-perf complains.  The message of check_perf
+   says so too.  */
+#define STRICT_PERF_MAX_SIZE 1024
+
+/* What check_perf found in a regex.  */
+enum perf_risk {
+  PERF_RISK_NONE,
+  PERF_RISK_NESTED_REPEAT,	/* as in \(a*\)* */
+  PERF_RISK_REPEATED_BACKREF,	/* as in \(a*\)*\1 or \(\(a\)\2\)* */
+  PERF_RISK_LARGE_REPEAT	/* as in a\{1,5000\} */
+};
+
+/* The state of check_perf as it scans a pattern.  */
+struct perf_scan {
+  const char *re;
+  idx_t sz;
+  idx_t i;
+  bool extended;
+  int n_groups;
+  /* Bit G - 1 is set if group G is repeated without bound.  */
+  unsigned int repeated_groups;
+  enum perf_risk risk;
+};
+
+/* What check_perf knows of a subexpression: the elements it has once
+   its bounded repetitions are expanded, whether it has a repetition
+   without bound or a back-reference, and the groups in it (bit G - 1
+   for group G).  */
+struct perf_info {
+  idx_t size;
+  bool unbounded;
+  bool backref;
+  unsigned int groups;
+};
+
+static void perf_alternation (struct perf_scan *, struct perf_info *, int);
+
+/* Return true if PS is at the token made of the character C, which
+   is preceded by a backslash in BREs unless PLAIN.  */
+static bool
+perf_at (struct perf_scan *ps, char c, bool plain)
+{
+  if (ps->extended || plain)
+    return ps->i < ps->sz && ps->re[ps->i] == c;
+  return (ps->i + 1 < ps->sz && ps->re[ps->i] == '\\'
+          && ps->re[ps->i + 1] == c);
+}
+
+/* Skip the token checked by perf_at.  */
+static void
+perf_skip (struct perf_scan *ps, bool plain)
+{
+  ps->i += ps->extended || plain ? 1 : 2;
+}
+
+/* Parse the number at PS, or return -1 if there is none.  */
+static idx_t
+perf_number (struct perf_scan *ps)
+{
+  idx_t n = -1;
+
+  for (; ps->i < ps->sz && ISDIGIT (ps->re[ps->i]); ps->i++)
+    n = MIN (MAX (n, 0) * 10 + (ps->re[ps->i] - '0'), RE_DUP_MAX + 1);
+  return n;
+}
+
+/* If PS is at a repetition operator, skip it, store its bounds in
+   *MIN and *MAX (-1 if there is none) and return true.  */
+static bool
+perf_repetition (struct perf_scan *ps, idx_t *min, idx_t *max)
+{
+  idx_t start = ps->i;
+
+  if (perf_at (ps, '*', true))
+    {
+      perf_skip (ps, true);
+      *min = 0, *max = -1;
+      return true;
+    }
+  if (perf_at (ps, '+', false) || perf_at (ps, '?', false))
+    {
+      *min = perf_at (ps, '+', false);
+      *max = *min ? -1 : 1;
+      perf_skip (ps, false);
+      return true;
+    }
+  if (perf_at (ps, '{', false))
+    {
+      perf_skip (ps, false);
+      *min = MAX (perf_number (ps), 0);
+      *max = *min;
+      if (ps->i < ps->sz && ps->re[ps->i] == ',')
+        {
+          ps->i++;
+          *max = perf_number (ps);
+        }
+      if (perf_at (ps, '}', false))
+        {
+          perf_skip (ps, false);
+          return true;
+        }
+      /* Not an interval, so the brace is an ordinary character.  */
+      ps->i = start;
+    }
+  return false;
+}
+
+/* Record in PS and INFO that INFO is repeated from MIN to MAX times
+   (without bound if MAX is negative).  */
+static void
+perf_repeat (struct perf_scan *ps, struct perf_info *info,
+             idx_t min, idx_t max)
+{
+  idx_t copies = max < 0 ? MAX (min, 1) : MAX (max, 1);
+
+  if (max < 0)
+    {
+      if (info->unbounded && !ps->risk)
+        ps->risk = PERF_RISK_NESTED_REPEAT;
+      if (info->backref && info->groups && !ps->risk)
+        ps->risk = PERF_RISK_REPEATED_BACKREF;
+      ps->repeated_groups |= info->groups;
+      info->unbounded = true;
+    }
+  if (ckd_mul (&info->size, info->size, copies))
+    info->size = IDX_MAX;
+}
+
+/* Parse the element at PS, with its repetitions, into INFO; DEPTH is
+   the number of groups around it.  Return false if there is none.  */
+static bool
+perf_element (struct perf_scan *ps, struct perf_info *info, int depth)
+{
+  const char *re = ps->re;
+  idx_t min, max;
+
+  info->size = 1;
+  info->unbounded = info->backref = false;
+  info->groups = 0;
+
+  if (ps->i == ps->sz || perf_at (ps, '|', false)
+      || (depth && perf_at (ps, ')', false)))
+    return false;
+
+  if (perf_at (ps, '(', false))
+    {
+      int g = ++ps->n_groups;
+
+      perf_skip (ps, false);
+      perf_alternation (ps, info, depth + 1);
+      if (perf_at (ps, ')', false))
+        perf_skip (ps, false);
+      if (g <= 32)
+        info->groups |= 1u << (g - 1);
+    }
+  else if (re[ps->i] == '[')
+    {
+      /* Skip the bracket expression, as needs_context_p does.  */
+      idx_t i = ps->i, sz = ps->sz;
+
+      if (i + 1 < sz && re[i + 1] == '^')
+        i++;
+      if (i + 1 < sz && re[i + 1] == ']')
+        i++;
+      for (i++; i < sz && re[i] != ']'; i++)
+        if (re[i] == '[' && i + 1 < sz
+            && (re[i + 1] == ':' || re[i + 1] == '.' || re[i + 1] == '='))
+          {
+            char delim = re[i + 1];
+            for (i += 2; i + 1 < sz && !(re[i] == delim && re[i + 1] == ']');
+                 i++)
+              continue;
+            i++;
+          }
+      ps->i = i + 1;
+    }
+  else if (re[ps->i] == '\\' && ps->i + 1 < ps->sz)
+    {
+      char c = re[ps->i + 1];
+
+      if ('1' <= c && c <= '9')
+        {
+          int g = c - '0';
+          info->backref = true;
+          if ((ps->repeated_groups & (1u << (g - 1))) && !ps->risk)
+            ps->risk = PERF_RISK_REPEATED_BACKREF;
+        }
+      ps->i += 2;
+    }
+  else
+    {
+      /* A leading '*' is an ordinary character.  */
+      if (re[ps->i] == '^' || re[ps->i] == '$')
+        info->size = 0;
+      ps->i++;
+    }
+
+  while (perf_repetition (ps, &min, &max))
+    perf_repeat (ps, info, min, max);
+  return true;
+}
+
+/* Parse the alternatives at PS into INFO; DEPTH is the number of
+   groups around them.  */
+static void
+perf_alternation (struct perf_scan *ps, struct perf_info *info, int depth)
+{
+  struct perf_info elt;
+
+  info->size = 0;
+  info->unbounded = info->backref = false;
+  info->groups = 0;
+
+  for (;;)
+    {
+      while (perf_element (ps, &elt, depth))
+        {
+          if (ckd_add (&info->size, info->size, elt.size))
+            info->size = IDX_MAX;
+          info->unbounded |= elt.unbounded;
+          info->backref |= elt.backref;
+          info->groups |= elt.groups;
+        }
+      if (!perf_at (ps, '|', false))
+        break;
+      perf_skip (ps, false);
+    }
+}
+
+/* Note with perf_prog, for --strict-perf, if REGEX has constructs that
+   are known to make the regex matcher backtrack a lot, or the DFA and
+   the regex matcher very large: repetitions of subexpressions that
+   contain repetitions themselves, back-references to or inside repeated
+   groups, and large bounded repetitions.  This is only an estimate,
+   made on the text of the pattern.  */
+static void
+check_perf (const struct regex *regex)
+{
+  struct perf_scan ps = { 0 };
+  struct perf_info info;
+
+  ps.re = regex->re;
+  ps.sz = regex->sz;
+  ps.extended = (extended_regexp_flags & REG_EXTENDED) != 0;
+  perf_alternation (&ps, &info, 0);
+
+  if (!ps.risk && STRICT_PERF_MAX_SIZE < info.size)
+    ps.risk = PERF_RISK_LARGE_REPEAT;
+
+  switch (ps.risk)
+    {
+    case PERF_RISK_NONE:
+      break;
+    case PERF_RISK_NESTED_REPEAT:
+      perf_prog ("regex has a repeated subexpression that contains a"
+                 " repetition, and may be very slow to match");
+      break;
+    case PERF_RISK_REPEATED_BACKREF:
+      perf_prog ("regex has a back-reference to or inside a repeated"
+                 " group, and may be very slow to match");
+      break;
+    case PERF_RISK_LARGE_REPEAT:
+      perf_prog ("regex has bounded repetitions that expand it to more"
+                 " than 1024 elements, and may be very large");
+      break;
+    }
+}
+
 struct regex *
 compile_regex (struct buffer *b, int flags, int needed_sub)
 {
@@ -150,47 +834,336 @@ compile_regex (struct buffer *b, int flags, int needed_sub)
   new_regex->sz = normalize_text (new_regex->re, re_len, TEXT_REGEX);
 
   compile_regex_1 (new_regex, needed_sub);
+  new_regex->needs_context = needs_context_p (new_regex->re, new_regex->sz);
+  if (!new_regex->begline && !new_regex->endline)
+    compile_literal (new_regex);
+  new_regex->max_len = max_match_length (new_regex);
+
+  check_perf (new_regex);
+
+  if (needed_sub)
+    compile_onepass (new_regex);
+
+  /* Back-references keep the DFA from telling where a match is.  */
+  if (localeinfo.simple && !(flags & (REG_ICASE | REG_NEWLINE)))
+    new_regex->backref = backref_compile (new_regex->re, new_regex->sz,
+                                          (extended_regexp_flags
+                                           & REG_EXTENDED) != 0,
+                                          new_regex->pattern.re_nsub);
   return new_regex;
 }
 
-int
-match_regex (struct regex *regex, char *buf, idx_t buflen,
-            idx_t buf_start_offset, struct re_registers *regarray,
-            int regsize)
+/* Compile REGEX, which was compiled without registers, again so that
+   it can find the first NEEDED_SUB of them.  */
+void
+recompile_regex (struct regex *regex, int needed_sub)
 {
-  int ret;
-  static struct regex *regex_last;
+  /* Re-compiling an existing regex, free the previously allocated
+     structures.  */
+  if (regex->dfa)
+    {
+      dfafree (regex->dfa);
+      free (regex->dfa);
+      regex->dfa = NULL;
+    }
+  regfree (&regex->pattern);
 
-  /* Keep track of the last regexp matched. */
-  if (!regex)
+  compile_regex_1 (regex, needed_sub);
+  compile_onepass (regex);
+}
+
+/* Return a DFA that matches wherever one of the N regexes in REGEXES
+   might match, or NULL if they cannot be combined.  They must all have
+   the same flags.  */
+struct dfa *
+compile_regex_set (struct regex *const *regexes, idx_t n)
+{
+  int flags = regexes[0]->flags;
+  reg_syntax_t syntax = regex_syntax (flags) | RE_NO_SUB | RE_NEWLINE_ALT;
+  int dfaopts = buffer_delimiter == '\n' ? 0 : DFA_EOL_NUL;
+  idx_t i, len = 0;
+  char *pattern, *p;
+  struct dfa *set;
+
+  /* The patterns are joined by newlines, which RE_NEWLINE_ALT turns
+     into alternation; that does not work without it, or for patterns
+     which contain newlines themselves.  */
+  if ((flags & REG_NEWLINE) || (syntax & RE_LIMITED_OPS))
+    return NULL;
+  for (i = 0; i < n; i++)
     {
-      regex = regex_last;
-      if (!regex_last)
-        bad_prog ("no previous regular expression");
+      if (memchr (regexes[i]->re, '\n', regexes[i]->sz))
+        return NULL;
+      len += regexes[i]->sz + 1;
     }
-  else
-    regex_last = regex;
 
-  regoff_t buflen_regoff;
-  if (ckd_add (&buflen_regoff, buflen, 0))
-    panic (_("regex input buffer length overflow"));
+  p = pattern = xmalloc (len);
+  for (i = 0; i < n; i++)
+    {
+      p = mempcpy (p, regexes[i]->re, regexes[i]->sz);
+      *p++ = '\n';
+    }
 
-  if (regex->pattern.no_sub && regsize)
+  set = dfaalloc ();
+  dfasyntax (set, &localeinfo, syntax, dfaopts);
+  dfaparse (pattern, len - 1, set);
+  dfacomp (NULL, 0, set, 1);
+  free (pattern);
+  return set;
+}
+
+/* Return false if none of the regexes combined in SET by
+   compile_regex_set can match BUF.  */
+bool
+match_regex_set (struct dfa *set, char *buf, idx_t buflen)
+{
+  struct dfa *superset = dfasuperset (set);
+  bool backref = false;
+
+  if (superset && !dfaexec (superset, buf, buf + buflen, true, NULL, NULL))
+    return false;
+  if (superset || !dfaisfast (set))
+    return true;
+  return dfaexec (set, buf, buf + buflen, true, NULL, &backref) != NULL;
+}
+
+/* Store in REGARRAY a match of the whole regex from START to END,
+   with no subexpression matches.  */
+static void
+set_match_registers (struct match_regs *regarray, idx_t start, idx_t end)
+{
+  idx_t i;
+
+  if (!regarray->start)
+    {
+      regarray->start = XNMALLOC (1, idx_t);
+      regarray->end = XNMALLOC (1, idx_t);
+      regarray->num_regs = 1;
+    }
+
+  regarray->start[0] = start;
+  regarray->end[0] = end;
+
+  for (i = 1 ; i < regarray->num_regs; ++i)
+    regarray->start[i] = regarray->end[i] = -1;
+}
+
+/* Return the leftmost of the longest occurrences, in BUF of length
+   BUFLEN and at offset START or later, of the alternatives of REGEX,
+   and store its length in *LEN; or return NULL if there is none.
+   Once an occurrence is found, the other alternatives are only looked
+   for before it.  */
+static const char *
+search_alternatives (const struct regex *regex, const char *buf,
+                     idx_t buflen, idx_t start, idx_t *len)
+{
+  const char *best = NULL;
+  idx_t i, best_len = 0;
+
+  for (i = 0; i < regex->n_alternatives; i++)
     {
-      /* Re-compiling an existing regex, free the previously allocated
-         structures.  */
-      if (regex->dfa)
+      idx_t alt_len = regex->alternative_len[i];
+      idx_t lim = best ? MIN (best - buf + alt_len, buflen) : buflen;
+      const char *p = memmem (buf + start, lim - start,
+                              regex->alternatives[i], alt_len);
+
+      if (p && (!best || p < best || alt_len > best_len))
         {
-          dfafree (regex->dfa);
-          free (regex->dfa);
-          regex->dfa = NULL;
+          best = p;
+          best_len = alt_len;
         }
-      regfree (&regex->pattern);
+    }
+
+  *len = best_len;
+  return best;
+}
 
-      compile_regex_1 (regex, regsize);
+/* Make TO a copy of the registers FROM.  */
+static void
+copy_registers (struct match_regs *to, const struct match_regs *from)
+{
+  if (to->num_regs != from->num_regs)
+    {
+      to->start = xnrealloc (to->start, from->num_regs, sizeof *to->start);
+      to->end = xnrealloc (to->end, from->num_regs, sizeof *to->end);
+      to->num_regs = from->num_regs;
     }
+  memcpy (to->start, from->start, from->num_regs * sizeof *from->start);
+  memcpy (to->end, from->end, from->num_regs * sizeof *from->end);
+}
+
+/* The steps that the current call to match_regex may still take, and
+   the time by which it must be over, with --regex-step-limit and
+   --regex-timeout.  Only the regex matcher and the matcher for
+   back-references, which can take more than linear time, count steps:
+   re_search one per start position that it tries.  */
+static idx_t steps_left;
+static xtime_t deadline;
+
+/* Return true if the current call to match_regex ran out of steps or
+   time.  */
+static bool
+over_budget (void)
+{
+  return ((regex_step_limit && steps_left <= 0)
+          || (regex_timeout && deadline <= gethrxtime ()));
+}
+
+/* Return true if a buffer of LEN bytes is short enough for re_search.  */
+static bool
+regoff_fits (idx_t len)
+{
+  regoff_t r;
+  return !ckd_add (&r, len, 0);
+}
+
+/* Run re_search on the text of BUF from offset BEG to offset END,
+   for a match starting between offsets START and START + RANGE, and
+   store its registers, as offsets into BUF, in REGARRAY unless it is
+   NULL.  Return the offset of the match, -1 if there is none, or -2 if
+   the search ran out of steps or time.  */
+static idx_t
+search_window (struct regex *regex, const char *buf, idx_t beg, idx_t end,
+               idx_t start, idx_t range, struct match_regs *regarray)
+{
+  static struct re_registers regs;
+  regoff_t ret;
+  idx_t i;
+
+  if (!regoff_fits (end - beg))
+    panic (_("regex input buffer length overflow"));
 
   regex->pattern.regs_allocated = REGS_REALLOCATE;
+  range = MIN (range, end - start);
+  if (!regex_step_limit && !regex_timeout)
+    ret = re_search (&regex->pattern, buf + beg, end - beg, start - beg,
+                     range, regarray ? &regs : NULL);
+  else
+    {
+      /* Try the start positions in chunks that double in size, so
+         that the budget is checked often at first, without calling
+         re_search once per position on long texts.  */
+      idx_t chunk = 1;
+
+      for (;;)
+        {
+          idx_t n = MIN (chunk, range + 1);
+
+          if (over_budget ())
+            return -2;
+          if (regex_step_limit)
+            {
+              n = MIN (n, steps_left);
+              steps_left -= n;
+            }
+          ret = re_search (&regex->pattern, buf + beg, end - beg,
+                           start - beg, n - 1, regarray ? &regs : NULL);
+          if (ret >= 0 || n == range + 1)
+            break;
+          start += n;
+          range -= n;
+          chunk = MIN (2 * chunk, IDX_MAX / 2);
+        }
+    }
+  if (ret < 0)
+    return -1;
+
+  if (regarray)
+    {
+      if (regarray->num_regs != regs.num_regs)
+        {
+          regarray->start = xnrealloc (regarray->start, regs.num_regs,
+                                       sizeof *regarray->start);
+          regarray->end = xnrealloc (regarray->end, regs.num_regs,
+                                     sizeof *regarray->end);
+          regarray->num_regs = regs.num_regs;
+        }
+      for (i = 0; i < regarray->num_regs; i++)
+        {
+          regarray->start[i] = regs.start[i] < 0 ? -1 : beg + regs.start[i];
+          regarray->end[i] = regs.end[i] < 0 ? -1 : beg + regs.end[i];
+        }
+    }
+
+  return beg + ret;
+}
+
+/* Return 1 if REGEX matches BUF as described for match_regex, 0 if it
+   does not, or -1 if it ran out of steps or time to tell.  */
+static int
+match_regex_1 (struct regex *regex, char *buf, idx_t buflen,
+               idx_t buf_start_offset, struct match_regs *regarray,
+               int regsize)
+{
+  idx_t ret;
+
+  /* re_search cannot take more than a regoff_t of text, so with longer
+     buffers the other matchers, which use idx_t offsets, find the match
+     or at least the part of the buffer that it spans.  */
+  bool too_long = !regoff_fits (buflen);
+
+  /* check_final_program recompiles the regexes that the empty regex
+     of an 's' command may stand for, but not those for which this
+     reports an error.  */
+  if (regex->pattern.no_sub && regsize)
+    recompile_regex (regex, regsize);
+  else if (too_long)
+    compile_onepass (regex);
+
+  /* Fixed strings need neither the DFA nor the regex matcher.  */
+  if (regex->literal)
+    {
+      const char *p = ((regex->flags & REG_ICASE)
+                       ? memmem_icase (buf + buf_start_offset,
+                                       buflen - buf_start_offset,
+                                       regex->literal, regex->literal_len)
+                       : memmem (buf + buf_start_offset,
+                                 buflen - buf_start_offset,
+                                 regex->literal, regex->literal_len));
+      if (!p)
+        return 0;
+      if (regsize)
+        set_match_registers (regarray, p - buf,
+                             p - buf + regex->literal_len);
+      return 1;
+    }
+
+  if (regex->alternatives)
+    {
+      idx_t len;
+      const char *p = search_alternatives (regex, buf, buflen,
+                                           buf_start_offset, &len);
+      if (!p)
+        return 0;
+      if (regsize)
+        {
+          set_match_registers (regarray, p - buf, p - buf + len);
+          if (regex->pattern.re_nsub)
+            {
+              if (regarray->num_regs < 2)
+                {
+                  regarray->start = xnrealloc (regarray->start, 2,
+                                               sizeof *regarray->start);
+                  regarray->end = xnrealloc (regarray->end, 2,
+                                             sizeof *regarray->end);
+                  regarray->num_regs = 2;
+                }
+              regarray->start[1] = p - buf + regex->alternative_prefix;
+              regarray->end[1] = p - buf + len - regex->alternative_suffix;
+            }
+        }
+      return 1;
+    }
+
+  /* A match starts at BUF_START_OFFSET or later, so the string it
+     must contain appears after that.  */
+  if (regex->must
+      && !((regex->flags & REG_ICASE)
+           ? memmem_icase (buf + buf_start_offset, buflen - buf_start_offset,
+                           regex->must, regex->must_len)
+           : memmem (buf + buf_start_offset, buflen - buf_start_offset,
+                     regex->must, regex->must_len)))
+    return 0;
 
   /* Optimized handling for '^' and '$' patterns */
   if (regex->begline || regex->endline)
@@ -237,50 +1210,63 @@ match_regex (struct regex *regex, char *buf, idx_t buflen,
         }
 
       if (regsize)
-        {
-          idx_t i;
-
-          if (!regarray->start)
-            {
-              regarray->start = XNMALLOC (1, regoff_t);
-              regarray->end = XNMALLOC (1, regoff_t);
-              regarray->num_regs = 1;
-            }
-
-          regarray->start[0] = offset;
-          regarray->end[0] = offset;
-
-          for (i = 1 ; i < regarray->num_regs; ++i)
-            regarray->start[i] = regarray->end[i] = -1;
-        }
+        set_match_registers (regarray, offset, offset);
 
       return 1;
     }
 
-  if (buf_start_offset == 0)
+  /* The DFA cannot tell what precedes the text it is given, so it is
+     only run from within the buffer (as for the later matches of
+     's///g') if the pattern does not care.  When it is exact, the first
+     match cannot start after the end of the first text it matches, so
+     re_search need not try the start positions beyond that.  */
+  char *match_end = NULL;
+  char *record_end = NULL;
+  bool sub_lines = ((regex->flags & REG_NEWLINE) && buffer_delimiter != '\n');
+  if (buf_start_offset == 0 || !regex->needs_context)
     {
       struct dfa *superset = dfasuperset (regex->dfa);
+      char *beg = buf + buf_start_offset;
 
-      if (superset && !dfaexec (superset, buf, buf + buflen, true, NULL, NULL))
+      if (superset && !dfaexec (superset, beg, buf + buflen, true, NULL, NULL))
         return 0;
 
-      if ((!regsize && (regex->flags & REG_NEWLINE))
-          || (!superset && dfaisfast (regex->dfa)))
+      /* The DFA treats the buffer delimiter as its end-of-line byte.
+         With M, it is run so that it starts over after each one, as
+         the regex matcher is run below on each line in turn.  */
+      if ((!regsize && (regex->flags & REG_NEWLINE)) || sub_lines
+          || (!superset && dfaisfast (regex->dfa)) || too_long)
         {
           bool backref = false;
 
-          if (!dfaexec (regex->dfa, buf, buf + buflen, true, NULL, &backref))
+          match_end = dfaexec (regex->dfa, beg, buf + buflen, !sub_lines,
+                               NULL, &backref);
+          if (!match_end)
             return 0;
 
-          if (!regsize && (regex->flags & REG_NEWLINE) && !backref)
+          /* Without M, the DFA only gets anchors right if the buffer
+             has no line delimiter for it to match after or before.  */
+          if (!regsize && !backref
+              && ((regex->flags & REG_NEWLINE)
+                  || (too_long
+                      && (!regex->needs_context
+                          || !memchr (buf, buffer_delimiter, buflen)))))
             return 1;
+
+          /* No match ends before this, even with back-references.  */
+          if (sub_lines)
+            record_end = match_end;
+
+          /* With anchors, the DFA also matches after each newline.  */
+          if (backref || regex->needs_context)
+            match_end = NULL;
         }
     }
 
   /* If the buffer delimiter is not newline character, we cannot use
      newline_anchor flag of regex.  So do it line-by-line, and add offset
      value to results.  */
-  if ((regex->flags & REG_NEWLINE) && buffer_delimiter != '\n')
+  if (sub_lines)
     {
       const char *beg, *end;
       const char *start;
@@ -297,6 +1283,17 @@ match_regex (struct regex *regex, char *buf, idx_t buflen,
 
       start = buf + buf_start_offset;
 
+      /* Skip the lines before the one where the DFA found the end of
+         a match, or the byte after it.  */
+      if (record_end && record_end - 1 > start)
+        {
+          const char *eol = memrchr (start, buffer_delimiter,
+                                     record_end - 1 - start);
+
+          if (eol != NULL)
+            beg = start = eol + 1;
+        }
+
       for (;;)
         {
           end = memchr (beg, buffer_delimiter, buf + buflen - beg);
@@ -304,29 +1301,12 @@ match_regex (struct regex *regex, char *buf, idx_t buflen,
           if (end == NULL)
             end = buf + buflen;
 
-          ret = re_search (&regex->pattern, beg, end - beg,
-                           start - beg, end - start,
-                           regsize ? regarray : NULL);
+          ret = search_window (regex, buf, beg - buf, end - buf,
+                               start - buf, end - start,
+                               regsize ? regarray : NULL);
 
-          if (ret > -1)
-            {
-              idx_t i;
-
-              ret += beg - buf;
-
-              if (regsize)
-                {
-                  for (i = 0; i < regarray->num_regs; ++i)
-                    {
-                      if (regarray->start[i] > -1)
-                        regarray->start[i] += beg - buf;
-                      if (regarray->end[i] > -1)
-                        regarray->end[i] += beg - buf;
-                    }
-                }
-
-              break;
-            }
+          if (ret != -1)
+            break;
 
           if (end == buf + buflen)
             break;
@@ -334,12 +1314,149 @@ match_regex (struct regex *regex, char *buf, idx_t buflen,
           beg = start = end + 1;
         }
     }
+  else if (regex->onepass && (regsize || too_long))
+    ret = onepass_search (regex->onepass, buf, buflen, buf_start_offset,
+                          ((match_end ? match_end - buf : buflen)
+                           - buf_start_offset),
+                          regsize ? regarray : NULL);
+  else
+    {
+      idx_t first = buf_start_offset;
+      idx_t last = match_end ? match_end - buf : buflen;
+      idx_t beg = 0, end = buflen;
+      idx_t start = -2;
+
+      /* Find where the match starts with bounded work if there are
+         back-references, and leave only the registers to re_search.  */
+      if (regex->backref)
+        {
+          idx_t steps = regex_step_limit ? steps_left : IDX_MAX;
+
+          start = backref_search (regex->backref, buf, buflen,
+                                  first, last - first, &steps);
+          if (regex_step_limit)
+            steps_left = steps;
+          if (start == -2 && over_budget ())
+            return -1;
+        }
+
+      /* The first match starts at most MAX_LEN bytes before the end of
+         the first text that the DFA matched, and is at most MAX_LEN
+         bytes long.  Trying only those start positions also keeps a
+         cheap search of a long line within --regex-step-limit.  */
+      if (match_end && 0 <= regex->max_len)
+        {
+          beg = first = MAX (first, last - regex->max_len);
+          end = MIN (buflen, last + regex->max_len);
+        }
+
+      if (start == -2)
+        ret = search_window (regex, buf, beg, end, first, last - first,
+                             regsize ? regarray : NULL);
+      else if (start < 0)
+        ret = -1;
+      else if (regsize)
+        ret = search_window (regex, buf, beg, end, start, 0, regarray);
+      else
+        ret = start;
+    }
+
+  return ret == -2 ? -1 : ret > -1;
+}
+
+
+/* Return nonzero if REGEX (or the last regex used, if NULL) matches BUF
+   of length BUFLEN at offset BUF_START_OFFSET or later, and if so,
+   store the first REGSIZE registers of the match in REGARRAY.  If
+   BUF_GENERATION is nonzero, BUF is known to be the same as in the
+   last call with that generation, if any, and the result of that call
+   is reused when it tells the answer.  If BUF_PREFIX_GENERATION is
+   nonzero, BUF starts with the text of any earlier call with that
+   prefix generation, and the part of it that REGEX did not match then
+   is not searched again.
+
+   With --regex-step-limit or --regex-timeout, if matching takes longer
+   than they allow, act as --regex-overrun says.  */
+int
+match_regex (struct regex *regex, char *buf, idx_t buflen,
+             idx_t buf_start_offset, struct match_regs *regarray,
+             int regsize, intmax_t buf_generation,
+             intmax_t buf_prefix_generation)
+{
+  idx_t start = buf_start_offset;
+  int ret;
+  bool overrun;
+  static struct regex *regex_last;
+
+  /* Keep track of the last regexp matched. */
+  if (!regex)
+    {
+      regex = regex_last;
+      if (!regex_last)
+        bad_prog ("no previous regular expression");
+    }
   else
-    ret = re_search (&regex->pattern, buf, buflen, buf_start_offset,
-                     buflen - buf_start_offset,
-                     regsize ? regarray : NULL);
+    regex_last = regex;
+
+  if (buf_generation
+      && buf_generation == regex->cache_generation
+      && buf_start_offset == regex->cache_start
+      && (!regex->cache_matched || !regsize
+          || regex->cache_regs.num_regs >= regsize))
+    {
+      if (regex->cache_matched && regsize)
+        copy_registers (regarray, &regex->cache_regs);
+      return regex->cache_matched;
+    }
+
+  /* A match in text that only grew since REGEX last failed to match
+     it must end in the new text, so it starts at most MAX_LEN - 1
+     bytes before.  */
+  if (buf_prefix_generation
+      && buf_prefix_generation == regex->resume_generation
+      && buf_start_offset == 0 && !regsize
+      && regex->resume_length <= buflen)
+    {
+      start = MAX (0, regex->resume_length - regex->max_len + 1);
+      if (is_utf8)
+        while (0 < start && start < buflen && (buf[start] & 0xc0) == 0x80)
+          start--;
+    }
 
-  return (ret > -1);
+  if (regex_step_limit)
+    steps_left = MIN (regex_step_limit, IDX_MAX);
+  if (regex_timeout)
+    deadline = gethrxtime () + MIN (regex_timeout, 1e9) * XTIME_PRECISION;
+
+  ret = start <= buflen ? match_regex_1 (regex, buf, buflen, start,
+                                         regarray, regsize) : 0;
+  overrun = ret < 0;
+  if (overrun)
+    {
+      if (regex_overrun == REGEX_OVERRUN_ERROR)
+        regex_overrun_error (regex, !(regex_step_limit && steps_left <= 0));
+      ret = 0;
+    }
+
+  /* The text that was not searched for lack of time must be searched
+     the next time.  */
+  if (buf_start_offset == 0 && !regsize && 0 <= regex->max_len)
+    {
+      regex->resume_generation = ret || overrun ? 0 : buf_prefix_generation;
+      regex->resume_length = buflen;
+    }
+
+  if (buf_generation)
+    {
+      regex->cache_generation = buf_generation;
+      regex->cache_start = buf_start_offset;
+      regex->cache_matched = ret;
+      if (ret && regsize)
+        copy_registers (&regex->cache_regs, regarray);
+      else
+        regex->cache_regs.num_regs = 0;
+    }
+  return ret;
 }
 
 
@@ -354,6 +1471,16 @@ release_regex (struct regex *regex)
       regex->dfa = NULL;
     }
   regfree (&regex->pattern);
+  free (regex->literal);
+  for (idx_t i = 0; i < regex->n_alternatives; i++)
+    free (regex->alternatives[i]);
+  free (regex->alternatives);
+  free (regex->alternative_len);
+  free (regex->must);
+  free (regex->cache_regs.start);
+  free (regex->cache_regs.end);
+  onepass_free (regex->onepass);
+  backref_free (regex->backref);
   free (regex);
 }
 #endif /* lint */
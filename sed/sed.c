@@ -68,6 +68,9 @@ bool debug = false;
 /* How do we edit files in-place? (we don't if NULL) */
 char *in_place_extension = NULL;
 
+/* The file indexing the lines of the input file (none if NULL) */
+char *line_index_file = NULL;
+
 /* The mode to use to read/write files, either "r"/"w" or "rb"/"wb".  */
 char const *read_mode = "r";
 char const *write_mode = "w";
@@ -83,6 +86,16 @@ enum posixicity_types posixicity;
 /* How long should the 'l' command's output line be? */
 intmax_t lcmd_out_line_len = 70;
 
+/* How many steps and seconds may a regex match take? (0 if no limit) */
+intmax_t regex_step_limit = 0;
+double regex_timeout = 0;
+
+/* What to do when a regex match takes longer than that.  */
+enum regex_overrun_types regex_overrun = REGEX_OVERRUN_ERROR;
+
+/* Should we check regexes for constructs that are slow to match? */
+enum strict_perf_types strict_perf = STRICT_PERF_NONE;
+
 /* The complete compiled SED program that we are going to run: */
 static struct vector *the_program = NULL;
 
@@ -157,16 +170,32 @@ Usage: %s [OPTION]... {script-only-if-no-other-script} [input-file]...\n\
 #endif
   fprintf (out, _("  -l N, --line-length=N\n\
                  specify the desired line-wrap length for the 'l' command\n"));
+  fprintf (out, _("      --line-index=FILE\n\
+                 keep an index of the input's lines in FILE, so that\n\
+                 line number addresses are reached without reading\n\
+                 the lines before them (one input file only)\n"));
   fprintf (out, _("  --posix\n\
                  disable all GNU extensions.\n"));
   fprintf (out, _("  -E, -r, --regexp-extended\n\
                  use extended regular expressions in the script\n\
                  (for portability use POSIX -E).\n"));
+  fprintf (out, _("      --regex-step-limit=N\n\
+                 stop matching a regular expression after trying it at\n\
+                 N start positions\n"));
+  fprintf (out, _("      --regex-timeout=SECONDS\n\
+                 stop matching a regular expression after SECONDS\n"));
+  fprintf (out, _("      --regex-overrun=POLICY\n\
+                 when a match is stopped, exit with an error\n\
+                 (POLICY 'error', the default) or assume that\n\
+                 the regular expression does not match ('no-match')\n"));
   fprintf (out, _("  -s, --separate\n\
                  consider files as separate rather than as a single,\n\
                  continuous long stream.\n"));
   fprintf (out, _("      --sandbox\n\
                  operate in sandbox mode (disable e/r/w commands).\n"));
+  fprintf (out, _("      --strict-perf[=warn]\n\
+                 reject (or with 'warn', warn about) regular expressions\n\
+                 in the script that may be very slow or very large\n"));
   fprintf (out, _("  -u, --unbuffered\n\
                  load minimal amounts of data from the input files and flush\n\
                  the output buffers more often\n"));
@@ -192,17 +221,26 @@ main (int argc, char **argv)
 #define SHORTOPTS "bsnrzuEe:f:l:i::V:"
 
   enum { SANDBOX_OPTION = CHAR_MAX+1,
-         DEBUG_OPTION
+         DEBUG_OPTION,
+         LINE_INDEX_OPTION,
+         REGEX_STEP_LIMIT_OPTION,
+         REGEX_TIMEOUT_OPTION,
+         REGEX_OVERRUN_OPTION,
+         STRICT_PERF_OPTION
     };
 
   static const struct option longopts[] = {
     {"binary", 0, NULL, 'b'},
     {"regexp-extended", 0, NULL, 'r'},
+    {"regex-step-limit", 1, NULL, REGEX_STEP_LIMIT_OPTION},
+    {"regex-timeout", 1, NULL, REGEX_TIMEOUT_OPTION},
+    {"regex-overrun", 1, NULL, REGEX_OVERRUN_OPTION},
     {"debug", 0, NULL, DEBUG_OPTION},
     {"expression", 1, NULL, 'e'},
     {"file", 1, NULL, 'f'},
     {"in-place", 2, NULL, 'i'},
     {"line-length", 1, NULL, 'l'},
+    {"line-index", 1, NULL, LINE_INDEX_OPTION},
     {"null-data", 0, NULL, 'z'},
     {"zero-terminated", 0, NULL, 'z'},
     {"quiet", 0, NULL, 'n'},
@@ -210,6 +248,7 @@ main (int argc, char **argv)
     {"silent", 0, NULL, 'n'},
     {"sandbox", 0, NULL, SANDBOX_OPTION},
     {"separate", 0, NULL, 's'},
+    {"strict-perf", 2, NULL, STRICT_PERF_OPTION},
     {"unbuffered", 0, NULL, 'u'},
     {"version", 0, NULL, 'v'},
     {"help", 0, NULL, 'h'},
@@ -333,6 +372,46 @@ main (int argc, char **argv)
           debug = true;
           break;
 
+        case LINE_INDEX_OPTION:
+          line_index_file = optarg;
+          break;
+
+        case REGEX_STEP_LIMIT_OPTION:
+          {
+            char *end;
+            regex_step_limit = strtoimax (optarg, &end, 10);
+            if (end == optarg || *end || regex_step_limit <= 0)
+              panic (_("invalid step limit: %s"), optarg);
+          }
+          break;
+
+        case REGEX_TIMEOUT_OPTION:
+          {
+            char *end;
+            regex_timeout = strtod (optarg, &end);
+            if (end == optarg || *end || !(0 < regex_timeout))
+              panic (_("invalid timeout: %s"), optarg);
+          }
+          break;
+
+        case REGEX_OVERRUN_OPTION:
+          if (strcmp (optarg, "error") == 0)
+            regex_overrun = REGEX_OVERRUN_ERROR;
+          else if (strcmp (optarg, "no-match") == 0)
+            regex_overrun = REGEX_OVERRUN_NO_MATCH;
+          else
+            panic (_("invalid regex overrun policy: %s"), optarg);
+          break;
+
+        case STRICT_PERF_OPTION:
+          if (!optarg || strcmp (optarg, "error") == 0)
+            strict_perf = STRICT_PERF_ERROR;
+          else if (strcmp (optarg, "warn") == 0)
+            strict_perf = STRICT_PERF_WARN;
+          else
+            panic (_("invalid --strict-perf argument: %s"), optarg);
+          break;
+
         case 'u':
           unbuffered = true;
           break;
@@ -363,6 +442,9 @@ main (int argc, char **argv)
     }
   check_final_program (the_program);
 
+  if (line_index_file && argc - optind != 1)
+    panic (_("option --line-index requires exactly one input file"));
+
 #if O_BINARY
   if (binary_mode)
     {
@@ -373,6 +455,14 @@ main (int argc, char **argv)
     }
 #endif
 
+  /* Unless every line must be flushed as it is written, give standard
+     output a larger buffer than stdio would choose for a pipe.  */
+  if (!unbuffered && !isatty (fileno (stdout)))
+    {
+      static char stdout_buffer[64 * 1024];
+      setvbuf (stdout, stdout_buffer, _IOFBF, sizeof stdout_buffer);
+    }
+
   if (debug)
     debug_print_program (the_program);
 
@@ -29,6 +29,20 @@ struct vector {
   struct sed_cmd *v;	/* a dynamically allocated array */
   idx_t v_allocated;	/* ... number of slots allocated */
   idx_t v_length;	/* ... number of slots in use */
+
+  /* Set by check_final_program.  With -n, once the line number is at
+     least END_LINE and the commands at the N_END_RANGES indices in
+     END_RANGES are closed ranges, no command with a visible effect
+     can run again.  END_LINE is -1 if this never happens.  */
+  intmax_t end_line;
+  idx_t *end_ranges;
+  idx_t n_end_ranges;
+
+  /* Set by check_final_program if an address or an 's' command uses
+     the empty regex, which stands for the last regex used; the
+     optimizations that skip matching a regex must then be left out,
+     since they would change what the empty regex means.  */
+  bool empty_regex;
 };
 
 /* This structure tracks files used by sed so that they may all be
@@ -47,6 +61,18 @@ struct text_buf {
   idx_t text_length;
 };
 
+struct onepass;
+struct backref;
+
+/* The registers of a match, like those of re_search but as offsets of
+   type idx_t, so that they can be beyond the range of regoff_t.  An
+   unused register is -1.  */
+struct match_regs {
+  idx_t num_regs;
+  idx_t *start;
+  idx_t *end;
+};
+
 struct regex {
   regex_t pattern;
   int flags;
@@ -54,6 +80,47 @@ struct regex {
   struct dfa *dfa;
   bool begline;
   bool endline;
+  /* If the pattern can only match a fixed string, that string.  */
+  char *literal;
+  idx_t literal_len;
+  /* If the pattern is an alternation of N_ALTERNATIVES fixed strings,
+     those strings and their lengths.  With a group around the
+     alternation, every string starts with the ALTERNATIVE_PREFIX bytes
+     before the group, and ends with the ALTERNATIVE_SUFFIX bytes after
+     it.  */
+  char **alternatives;
+  idx_t *alternative_len;
+  idx_t n_alternatives;
+  idx_t alternative_prefix;
+  idx_t alternative_suffix;
+  /* A string that every match contains, or NULL.  */
+  char *must;
+  idx_t must_len;
+  /* Whether the pattern may contain anchors or word boundaries, which
+     depend on the text before a match.  */
+  bool needs_context;
+  /* A linear-time matcher computing the registers, or NULL.  */
+  struct onepass *onepass;
+  /* Whether compile_onepass was called, so that it is not called again
+     on a pattern that onepass_compile does not handle.  */
+  bool onepass_tried;
+  /* A matcher that finds where the leftmost match starts despite
+     back-references, with bounded work, or NULL.  */
+  struct backref *backref;
+  /* The result of the last call to match_regex with a nonzero buffer
+     generation: that generation, the start offset, and whether the
+     regex matched, in which case CACHE_REGS holds the registers, if
+     they were asked for (otherwise its NUM_REGS is zero).  */
+  intmax_t cache_generation;
+  idx_t cache_start;
+  bool cache_matched;
+  struct match_regs cache_regs;
+  /* The most bytes that a match can span, or -1 if unbounded.  */
+  idx_t max_len;
+  /* If nonzero, the prefix generation of the text that the regex did
+     not match, when it was RESUME_LENGTH bytes long.  */
+  intmax_t resume_generation;
+  idx_t resume_length;
   char re[1];
 };
 
@@ -89,6 +156,21 @@ enum posixicity_types {
   POSIXLY_BASIC		/* pedantically POSIX */
 };
 
+/* What to do when matching a regex takes longer than
+   --regex-step-limit or --regex-timeout allow.  */
+enum regex_overrun_types {
+  REGEX_OVERRUN_ERROR,		/* report an error and exit */
+  REGEX_OVERRUN_NO_MATCH	/* act as if the regex did not match */
+};
+
+/* What to do with regexes that may be very slow to match, or very
+   large once compiled.  */
+enum strict_perf_types {
+  STRICT_PERF_NONE,		/* nothing */
+  STRICT_PERF_WARN,		/* print a warning */
+  STRICT_PERF_ERROR		/* report an error and exit */
+};
+
 enum addr_state {
   RANGE_INACTIVE,	/* never been active */
   RANGE_ACTIVE,		/* between first and second address */
@@ -151,6 +233,13 @@ struct sed_cmd {
   /* The actual command character. */
   char cmd;
 
+  /* Set by check_final_program on the first of a run of ADDR_SET_LENGTH
+     commands that are each addressed by a single regex: a DFA matching
+     wherever one of those regexes might match.  If it does not match
+     the pattern space, none of these commands runs.  */
+  struct dfa *addr_set;
+  idx_t addr_set_length;
+
   /* auxiliary data for various commands */
   union {
     /* This structure is used for a, i, and c commands. */
@@ -189,6 +278,7 @@ _Noreturn void bad_prog (char const *why, ...)
   _GL_ATTRIBUTE_FORMAT_PRINTF_STANDARD (1, 2);
 _Noreturn void bad_prog_notranslate (char const *why, ...)
   _GL_ATTRIBUTE_FORMAT_PRINTF_STANDARD (1, 2);
+void perf_prog (char const *why);
 idx_t normalize_text (char *text, idx_t len, enum text_types buftype);
 struct vector *compile_string (struct vector *, char *str, idx_t len);
 struct vector *compile_file (struct vector *, const char *cmdfile);
@@ -197,12 +287,46 @@ void rewind_read_files (void);
 void finish_program (struct vector *);
 
 struct regex *compile_regex (struct buffer *b, int flags, int needed_sub);
+void recompile_regex (struct regex *regex, int needed_sub);
 int match_regex (struct regex *regex,
                  char *buf, idx_t buflen, idx_t buf_start_offset,
-                 struct re_registers *regarray, int regsize);
+                 struct match_regs *regarray, int regsize,
+                 intmax_t buf_generation, intmax_t buf_prefix_generation);
 #ifdef lint
 void release_regex (struct regex *);
 #endif
+struct dfa *compile_regex_set (struct regex *const *regexes, idx_t n);
+bool match_regex_set (struct dfa *set, char *buf, idx_t buflen);
+bool regex_special_char_p (unsigned char c, bool extended);
+
+/* The longest patterns that simple_regex_parse handles, in elements.  */
+#define SIMPLE_REGEX_MAX_ELTS 256
+
+/* An element of such a pattern: a byte in SET, or if REF is nonzero,
+   the text of group REF; if OPTIONAL, it can be skipped, and if
+   REPEAT, matched again.  */
+struct simple_elt {
+  unsigned char set[256];
+  int ref;
+  bool optional;
+  bool repeat;
+};
+
+int simple_regex_parse (const char *re, idx_t sz, bool extended, idx_t nsub,
+                        bool backrefs, struct simple_elt *elts,
+                        int *group_open, int *group_close,
+                        bool *anchor_start, bool *anchor_end);
+struct onepass *onepass_compile (const char *re, idx_t sz, bool extended,
+                                 idx_t nsub);
+idx_t onepass_search (struct onepass *op, const char *buf, idx_t buflen,
+                      idx_t start, idx_t range, struct match_regs *regs);
+void onepass_free (struct onepass *op);
+
+struct backref *backref_compile (const char *re, idx_t sz, bool extended,
+                                 idx_t nsub);
+idx_t backref_search (struct backref *br, const char *buf, idx_t buflen,
+                      idx_t start, idx_t range, idx_t *steps);
+void backref_free (struct backref *br);
 
 void
 debug_print_command (const struct vector *program, const struct sed_cmd *sc);
@@ -212,6 +336,8 @@ void
 debug_print_char (char c);
 
 int process_files (struct vector *, char **argv);
+_Noreturn void regex_overrun_error (const struct regex *regex,
+                                    bool timed_out);
 
 int main (int, char **);
 
@@ -241,9 +367,22 @@ extern enum posixicity_types posixicity;
 /* How long should the 'l' command's output line be? */
 extern intmax_t lcmd_out_line_len;
 
+/* How many steps and seconds may a regex match take? (0 if no limit) */
+extern intmax_t regex_step_limit;
+extern double regex_timeout;
+
+/* What to do when a regex match takes longer than that.  */
+extern enum regex_overrun_types regex_overrun;
+
+/* Should we check regexes for constructs that are slow to match? */
+extern enum strict_perf_types strict_perf;
+
 /* How do we edit files in-place? (we don't if NULL) */
 extern char *in_place_extension;
 
+/* The file indexing the lines of the input file (none if NULL) */
+extern char *line_index_file;
+
 /* The mode to use to read and write files, either "rt"/"w" or "rb"/"wb".  */
 extern char const *read_mode;
 extern char const *write_mode;
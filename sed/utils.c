@@ -236,6 +236,19 @@ ck_fwrite (const void *ptr, idx_t size, idx_t nmemb, FILE *stream)
           strerror (errno));
 }
 
+/* Write SIZE bytes from PTR followed by the byte DELIM to STREAM,
+   checking for errors only once.  Panic on failure.  */
+void
+ck_fwrite_delim (const void *ptr, idx_t size, char delim, FILE *stream)
+{
+  clearerr (stream);
+  if ((size && fwrite (ptr, 1, size, stream) != size)
+      || putc (delim, stream) == EOF)
+    panic (ngettext ("couldn't write %jd item to %s: %s",
+                     "couldn't write %jd items to %s: %s", size + 1),
+           size + (intmax_t) 1, utils_fp_name (stream), strerror (errno));
+}
+
 /* Panic on failing fread */
 idx_t
 ck_fread (void *ptr, idx_t size, idx_t nmemb, FILE *stream)
@@ -247,6 +260,25 @@ ck_fread (void *ptr, idx_t size, idx_t nmemb, FILE *stream)
   return nmemb;
 }
 
+/* Read up to SIZE bytes from the file descriptor underlying STREAM
+   into PTR, bypassing STREAM's buffer, and so the text-mode translation
+   of platforms with O_BINARY.  Panic on failure; return the number of
+   bytes read, which is zero at end of file.  */
+idx_t
+ck_read (void *ptr, idx_t size, FILE *stream)
+{
+  ssize_t result;
+
+  do
+    result = read (fileno (stream), ptr, MIN (size, SSIZE_IDX_MAX));
+  while (result < 0 && errno == EINTR);
+
+  if (result < 0)
+    panic (_("read error on %s: %s"), utils_fp_name (stream), strerror (errno));
+
+  return result;
+}
+
 ssize_t
 ck_getdelim (char **text, size_t *buflen, char delim, FILE *stream)
 {
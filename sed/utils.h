@@ -32,7 +32,9 @@ _Noreturn void panic (const char *str, ...)
 FILE *ck_fopen (const char *name, const char *mode, int fail);
 FILE *ck_fdopen (int fd, const char *name, const char *mode, int fail);
 void ck_fwrite (const void *ptr, idx_t size, idx_t nmemb, FILE *stream);
+void ck_fwrite_delim (const void *ptr, idx_t size, char delim, FILE *stream);
 idx_t ck_fread (void *ptr, idx_t size, idx_t nmemb, FILE *stream);
+idx_t ck_read (void *ptr, idx_t size, FILE *stream);
 void ck_fflush (FILE *stream);
 void ck_fclose (FILE *stream);
 const char *follow_symlink (const char *path);
@@ -0,0 +1,50 @@
+#!/bin/sh
+# Test that with -n, sed stops reading once no command can print anything.
+
+# Copyright (C) 2024 Free Software Foundation, Inc.
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+. "${srcdir=.}/testsuite/init.sh"; path_prepend_ ./sed
+print_ver_ sed
+
+printf '1\n2\n3\n4\n5\n' > in1 || framework_failure_
+printf 'a\nb\nc\n' > in2 || framework_failure_
+
+# Standard input is left just after the last line that was needed.
+printf '2\n3\n4\n5\n' > exp1 || framework_failure_
+(sed -n 2p; cat) < in1 > out1 || fail=1
+compare exp1 out1 || fail=1
+
+# Ranges starting at a line number end the program once closed.
+printf '2\n2\n3\n3\n4\n' > exp2 || framework_failure_
+(sed -n '2,/3/{p;=}'; sed 1q) < in1 > out2 || fail=1
+compare exp2 out2 || fail=1
+
+# Files after the end are still checked for errors.
+printf '2\n' > exp3 || framework_failure_
+returns_ 2 sed -n 2p in1 missing in2 > out3 2> err3 || fail=1
+compare exp3 out3 || fail=1
+grep missing err3 > /dev/null || fail=1
+
+# With -s, the program is restarted on each file.
+printf '2\nb\n' > exp4 || framework_failure_
+sed -s -n 2p in1 in2 > out4 || fail=1
+compare exp4 out4 || fail=1
+
+# A label inside a block can be reached without going through the '{'.
+printf '2\n4\n' > exp5 || framework_failure_
+sed -n '2{:a;p;n};4b a' in1 > out5 || fail=1
+compare exp5 out5 || fail=1
+
+Exit $fail
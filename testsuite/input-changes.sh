@@ -0,0 +1,36 @@
+#!/bin/sh
+# Test input files that shrink or grow while sed reads them.
+
+# Copyright (C) 2024 Free Software Foundation, Inc.
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+. "${srcdir=.}/testsuite/init.sh"; path_prepend_ ./sed
+print_ver_ sed
+
+# Text appended to the file after sed opened it is read as well.
+printf 'a\nb\n' > in1 || framework_failure_
+printf 'a\nb\nc\n' > exp1 || framework_failure_
+sed '1e echo c >> in1' in1 > out1 || fail=1
+compare exp1 out1 || fail=1
+
+# A file truncated (as by logrotate's copytruncate) while sed reads it
+# ends where it now ends; sed used to crash on a mapped file here.
+seq 500000 > in2 || framework_failure_
+cp in2 copy2 || framework_failure_
+sed '1e : > in2' in2 > out2 || fail=1
+test -s out2 || fail=1
+head -c "$(wc -c < out2)" copy2 > exp2 || framework_failure_
+compare exp2 out2 || fail=1
+
+Exit $fail
@@ -0,0 +1,74 @@
+#!/bin/sh
+# Test the --line-index option.
+
+# Copyright (C) 2024 Free Software Foundation, Inc.
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+. "${srcdir=.}/testsuite/init.sh"; path_prepend_ ./sed
+print_ver_ sed
+
+seq 20000 > in || framework_failure_
+
+# The index is created on first use, and used afterwards.
+printf '4096\n4097\n12289\n' > exp1 || framework_failure_
+for i in 1 2; do
+  sed -n --line-index=idx '4096p;4097p;12289p' in > out1 || fail=1
+  compare exp1 out1 || fail=1
+done
+test -s idx || fail=1
+
+seq 19998 20000 > exp2 || framework_failure_
+sed --line-index=idx 1,19997d in > out2 || fail=1
+compare exp2 out2 || fail=1
+
+# An index that does not match the input is made again.
+seq 20001 > in || framework_failure_
+printf '20001\n' > exp3 || framework_failure_
+sed -n --line-index=idx 20001p in > out3 || fail=1
+compare exp3 out3 || fail=1
+
+printf 'sed-line-index 4096 10 1 1\n5\n' > idx || framework_failure_
+printf '8200\n' > exp4 || framework_failure_
+sed -n --line-index=idx 8200p in > out4 || fail=1
+compare exp4 out4 || fail=1
+
+# An index made for another file of the same size and modification
+# time is not used either.
+seq 20000 > in6 || framework_failure_
+{ printf xx && seq 2 20000; } > in7 || framework_failure_
+touch -r in6 in7 || framework_failure_
+printf '8200\n' > exp6 || framework_failure_
+sed -n --line-index=idx6 8200p in6 > out6 || fail=1
+compare exp6 out6 || fail=1
+printf '8201\n' > exp7 || framework_failure_
+sed -n --line-index=idx6 8200p in7 > out7 || fail=1
+compare exp7 out7 || fail=1
+
+# An index that cannot be saved is only warned about.
+sed -n --line-index=no-such-dir/idx 8200p in6 > out8 2> err8 || fail=1
+compare exp6 out8 || fail=1
+grep warning err8 > /dev/null || fail=1
+
+# Line 1 of standard input is where its offset was when sed started.
+seq 20000 > in9 || framework_failure_
+printf '8201\n' > exp9 || framework_failure_
+sed -n --line-index=idx9 8200p in9 > /dev/null || fail=1
+{ read x && sed -n --line-index=idx9 8200p -; } < in9 > out9 || fail=1
+compare exp9 out9 || fail=1
+
+# Only one input file can be indexed.
+returns_ 4 sed -n --line-index=idx 1p in in > /dev/null 2> err5 || fail=1
+grep line-index err5 > /dev/null || fail=1
+
+Exit $fail
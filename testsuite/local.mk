@@ -56,12 +56,15 @@ T =					\
   testsuite/convert-number.sh		\
   testsuite/command-endings.sh		\
   testsuite/debug.pl			\
+  testsuite/early-exit.sh		\
   testsuite/execute-tests.sh		\
   testsuite/help-version.sh		\
   testsuite/in-place-hyphen.sh		\
   testsuite/in-place-suffix-backup.sh	\
   testsuite/inplace-selinux.sh		\
+  testsuite/input-changes.sh		\
   testsuite/invalid-mb-seq-UMR.sh	\
+  testsuite/line-index.sh		\
   testsuite/mb-bad-delim.sh		\
   testsuite/mb-charclass-non-utf8.sh	\
   testsuite/mb-match-slash.sh		\
@@ -80,10 +83,15 @@ T =					\
   testsuite/posix-mode-N.sh		\
   testsuite/range-overlap.sh		\
   testsuite/recursive-escape-c.sh	\
+  testsuite/regex-append.sh		\
   testsuite/regex-errors.sh		\
+  testsuite/regex-literal.sh		\
   testsuite/regex-max-int.sh		\
+  testsuite/regex-overrun.sh		\
   testsuite/sandbox.sh			\
+  testsuite/skip-lines.sh		\
   testsuite/stdin-prog.sh		\
+  testsuite/strict-perf.sh		\
   testsuite/subst-options.sh		\
   testsuite/subst-mb-incomplete.sh	\
   testsuite/subst-replacement.sh	\
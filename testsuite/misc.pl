@@ -42,6 +42,11 @@ my @Tests =
       {IN=>"a\0b\0c\0" },
       {OUT=>"XXaY\0XbY\0XcYY\0" }],
 
+     ['zero-anchor-lines', qw(-z),
+      q|'N;N;N;/a.b/Md;/^\(c\)\1$/M{s//<\1>/;s/x*$/E/M3}'|,
+      {IN=>"a\0b\0cc\0d\0" },
+      {OUT=>"a\0b\0<c>E\0d\0" }],
+
      ['case-insensitive', qw(-n), q('h;s/Version: *//p;g;s/version: *//Ip'),
       {IN=>"Version: 1.2.3\n" },
       {OUT=>"1.2.3\n1.2.3\n" },
@@ -74,6 +79,62 @@ y/Ss\nYy/yY$sS/'),
       {OUT=> "bar bar fo oo f oo bar bar bar bar bar bar bar bar bar\n"},
       ],
 
+     ['allsub-context', q('N;s/^ab/Z/g;s/\bab/X/g;s/cd\|ef/Y/g'),
+      {IN => "ab xab cd ef abab\nab\n"},
+      {OUT=> "Z xab Y Y Xab\nX\n"},
+      ],
+
+     # Runs of commands addressed by regexes are skipped together.
+     ['addr-set', q('/^a/d;/b$/s/b/a/;/^a/d;/c/s/^/x/'),
+      {IN => "a1\n2b\nc\nd\n"},
+      {OUT=> "2a\nxc\nd\n"},
+      ],
+     ['addr-set-flags', q('/X/Id;/y/d;/Z/Id'),
+      {IN => "x\nY\ny\nz\n"},
+      {OUT=> "Y\n"},
+      ],
+
+     # Regexes tested again after the pattern space changes.
+     ['regex-generation', qw(-n), q('/a/{y/a/b/;/a/p;x;/a/p;x;/b/p}'),
+      {IN => "ab\nb\n"},
+      {OUT=> "bb\n"},
+      ],
+     ['regex-generation-subst', qw(-n), q('s/a/X/;/a/{s//Y/;/a/p;p}'),
+      {IN => "aa\n"},
+      {OUT=> "XY\n"},
+      ],
+
+     # Regexes that 's//' reuses with groups, along each path of the script.
+     ['empty-regex-sub',
+      q|'/\(a\)b/s//<\1>/;s/\(c\)/[\1]/;t e;s/\(.\)$/&/;s//{\1}/;:e'|,
+      {IN => "ab\nccx\nxy\n"},
+      {OUT=> "<a>\n[c]cx\nx{y}\n"},
+      ],
+     ['empty-regex-sub-cycle', q|'1{/\(.\)\(.\)/d};s//<\2\1>/'|,
+      {IN => "ab\nccx\nxy\n"},
+      {OUT=> "<cc>x\n<yx>\n"},
+      ],
+
+     # Registers computed by the linear-time matcher.
+     ['subst-onepass', q|'s/\([a-z]*\)=\([0-9]*\)/\2=\1/g'|,
+      {IN => "foo=12 bar=3 =4 x\n"},
+      {OUT=> "12=foo 3=bar 4= x\n"},
+      ],
+     ['subst-onepass-ere', qw(-E), q('s/(b+)(c?)/<\1|\2>/g'),
+      {IN => "abbbc ac xbx\n"},
+      {OUT=> "a<bbb|c> ac x<b|>x\n"},
+      ],
+
+     # Back-references, with bounded backtracking.
+     ['backref-address', qw(-n), q|'/^\(a*\)b\1$/p'|,
+      {IN => "aabaa\naaba\nb\n"},
+      {OUT=> "aabaa\nb\n"},
+      ],
+     ['backref-subst', q|'s/\([a-z]\)\1/<\1>/g'|,
+      {IN => "aabbcd xx\n"},
+      {OUT=> "<a><b>cd <x>\n"},
+      ],
+
      ['insert-nl', qw(-f), {IN => "/foo/i\\\n"},
       {IN => "bar\nfoo\n" },
       {OUT=> "bar\n\nfoo\n" },
@@ -1084,6 +1145,12 @@ foo foo fo oo f oo foo foo foo foo foo foo foo foo foo foo foo foo foo
             . "MOO\n"}
      ],
 
+     # 'r /dev/stdin' shares standard input with the main input, which
+     # must then be read a line at a time as with 'R /dev/stdin'.
+     ['readin-stdin', q('1r /dev/stdin'),
+      {IN_PIPE => "a\nb\nc\n"},
+      {OUT => "a\nb\nc\n"}],
+
 
      ['sep',
       # inspired by an autoconf generated configure script.
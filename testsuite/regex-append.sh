@@ -0,0 +1,58 @@
+#!/bin/sh
+# Test regexes on a pattern space that grows from one test to the next.
+
+# Copyright (C) 2024 Free Software Foundation, Inc.
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+. "${srcdir=.}/testsuite/init.sh"; path_prepend_ ./sed
+print_ver_ sed
+
+printf 'a\nb\nc\nEND\nd\nEND\ne\n' > in1 || framework_failure_
+
+# Matches that span the text before and after each 'N'.
+printf 'a+b+c+END\nd+END\ne\n' > exp1 || framework_failure_
+sed ':a;$b;N;/END/!ba;s/\n/+/g' in1 > out1 || fail=1
+compare exp1 out1 || fail=1
+
+printf 'a+b+c\nEND+d+END\ne\n' > exp2 || framework_failure_
+sed ':a;$b;N;/b\nc\|d\nE/!ba;s/\n/+/g' in1 > out2 || fail=1
+compare exp2 out2 || fail=1
+
+printf 'a+b+c+E\nND\nd+E\nND\ne\n' > exp3 || framework_failure_
+sed ':a;$b;N;/c.E\|d.E/!ba;s/\n/+/g;s/E/&\n/' in1 > out3 || fail=1
+compare exp3 out3 || fail=1
+
+# Anchors, which only match at the ends of the pattern space.
+printf 'a+b+c+END\nd+END\ne\n' > exp4 || framework_failure_
+sed ':a;$b;N;/N.$/!ba;s/\n/+/g' in1 > out4 || fail=1
+compare exp4 out4 || fail=1
+sed ':a;$b;N;/^a/{/c\nE/!ba};s/\n/+/g' in1 > out5 || fail=1
+compare exp4 out5 || fail=1
+
+# The hold space grows with 'H', and is emptied between files with -s.
+printf 'a\nb\n' > in2 || framework_failure_
+printf 'b\nb\n' > in3 || framework_failure_
+printf '\nb\nb\n' > exp6 || framework_failure_
+sed -s -n 'H;x;/b\nb/p;x' in2 in3 > out6 || fail=1
+compare exp6 out6 || fail=1
+
+# Long records are assembled without searching them from the start
+# each time.
+seq 100000 > in7 || framework_failure_
+echo END >> in7 || framework_failure_
+printf '100000\n' > exp7 || framework_failure_
+sed -n ':a;N;/\nEND/!ba;s/.*\n\(.*\)\nEND$/\1/p' in7 > out7 || fail=1
+compare exp7 out7 || fail=1
+
+Exit $fail
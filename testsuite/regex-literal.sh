@@ -0,0 +1,88 @@
+#!/bin/sh
+# Test regular expressions that match or contain a fixed string.
+
+# Copyright (C) 2024 Free Software Foundation, Inc.
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+. "${srcdir=.}/testsuite/init.sh"; path_prepend_ ./sed
+print_ver_ sed
+
+printf 'a.b axb a+b (a) a|b\n' > in || framework_failure_
+
+# Escaped special characters, and characters that are only special
+# in one of the syntaxes.
+printf 'X axb a+b (a) a|b\n' > exp1 || framework_failure_
+sed 's/a\.b/X/' in > out1 || fail=1
+compare exp1 out1 || fail=1
+
+printf 'a.b axb X (a) X\n' > exp2 || framework_failure_
+sed 's/a+b/X/;s/a|b/X/' in > out2 || fail=1
+compare exp2 out2 || fail=1
+sed -E 's/a\+b/X/;s/a\|b/X/' in > out3 || fail=1
+compare exp2 out3 || fail=1
+
+printf 'a.b axb a+b X a|b\n' > exp4 || framework_failure_
+sed -E 's/\(a\)/X/' in > out4 || fail=1
+compare exp4 out4 || fail=1
+
+# Every occurrence, the Nth one, and the matched text.
+printf '[a].b [a]xb [a]+b ([a]) [a]|b\n' > exp5 || framework_failure_
+sed 's/a/[&]/g' in > out5 || fail=1
+compare exp5 out5 || fail=1
+
+printf 'a.b axb a+b (a) X\n' > exp6 || framework_failure_
+sed 's/a/X/5;s/X|b/X/' in > out6 || fail=1
+compare exp6 out6 || fail=1
+
+# Strings spanning lines in the pattern space.
+printf 'a.b+axb a+b (a) a|b\n' > exp7 || framework_failure_
+printf 'a.b\naxb a+b (a) a|b\n' | sed 'N;s/b\na/b+a/' > out7 || fail=1
+compare exp7 out7 || fail=1
+
+# Patterns whose matches all contain a fixed string.
+printf 'user=12 action=login\nuser=x action=login\n' > in8 || framework_failure_
+printf 'user=12 action=login\n' > exp8 || framework_failure_
+sed -n '/user=[0-9][0-9]* action=login/p' in8 > out8 || fail=1
+compare exp8 out8 || fail=1
+
+printf 'U action=login\nU action=login\n' > exp9 || framework_failure_
+sed 's/u[a-z]*=[0-9x]*/U/g' in8 > out9 || fail=1
+compare exp9 out9 || fail=1
+
+# Alternations of fixed strings: the longest one wins at a position.
+printf 'GET /a\nPOST /b\nPUTx\n' > in10 || framework_failure_
+printf '<GET> /a\n<POST> /b\nPUTx\n' > exp10 || framework_failure_
+sed 's/\(GET\|POST\|PUT\) /<\1> /' in10 > out10 || fail=1
+compare exp10 out10 || fail=1
+
+printf '[bcd] [b] ace\n' > exp11 || framework_failure_
+echo 'abcde abe ace' | sed -E 's/a(b|bc|bcd)e/[\1]/g' > out11 || fail=1
+compare exp11 out11 || fail=1
+
+printf 'aX X\n' > exp12 || framework_failure_
+echo 'abc b' | sed 's/b\|bc/X/g' > out12 || fail=1
+compare exp12 out12 || fail=1
+
+# Case-insensitive fixed strings, and strings that matches contain.
+printf 'An ERROR\nErRoR: x\nerr\n' > in13 || framework_failure_
+printf 'An ERROR\nErRoR: x\n' > exp13 || framework_failure_
+sed -n '/error/Ip' in13 > out13 || fail=1
+compare exp13 out13 || fail=1
+
+printf 'ERROR: disk\nerror:net\nTerror: x\n' > in14 || framework_failure_
+printf 'ERROR: disk\nTerror: x\n' > exp14 || framework_failure_
+sed -n '/RROR: [a-z]/Ip' in14 > out14 || fail=1
+compare exp14 out14 || fail=1
+
+Exit $fail
@@ -33,16 +33,21 @@ printf aaaa >>  input || framework_failure_
 truncate -s +1G input || framework_failure_
 printf 'a\n' >> input || framework_failure_
 
-# The expected error message
-cat <<\EOF > exp-err1 || framework_failure_
-sed: regex input buffer length larger than INT_MAX
-EOF
-
-
 # Before sed-4.5, this was silently a no-op: would not perform the subsitution
 # but would not indicate any error either (https://bugs.gnu.org/30520).
-# Exit code 4 is "panic".
-returns_ 4 sed 's/a/b/g' input >/dev/null 2>err1 || fail=1
-compare_ exp-err1 err1 || fail=1
+# Then it failed with "regex input buffer length larger than INT_MAX".
+# The second match, and its registers, are beyond INT_MAX.
+truncate -s 1G  exp || framework_failure_
+printf baaa >>  exp || framework_failure_
+truncate -s +1G exp || framework_failure_
+printf 'b\n' >> exp || framework_failure_
+
+sed 's/a\(a*\)/b\1/g' input > out || fail=1
+cmp exp out || fail=1
+rm -f exp out
+
+echo 1 > exp1 || framework_failure_
+sed -n '/a$/=' input > out1 || fail=1
+compare exp1 out1 || fail=1
 
 Exit $fail
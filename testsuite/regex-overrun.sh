@@ -0,0 +1,72 @@
+#!/bin/sh
+# Test the --regex-step-limit, --regex-timeout and --regex-overrun options.
+
+# Copyright (C) 2024 Free Software Foundation, Inc.
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+. "${srcdir=.}/testsuite/init.sh"; path_prepend_ ./sed
+print_ver_ sed
+
+# The regex matcher tries the first 11 positions of the line before it
+# finds the match.
+printf 'x\nzzzzzzzzzzab\n' > in || framework_failure_
+
+printf 'x\nzzzzzzzzzzX\n' > exp1 || framework_failure_
+sed --regex-step-limit=11 's/\(a*\)*\1b/X/' in > out1 || fail=1
+compare exp1 out1 || fail=1
+sed --regex-timeout=60 's/\(a*\)*\1b/X/' in > out2 || fail=1
+compare exp1 out2 || fail=1
+
+cat <<\EOF2 > exp-err3 || framework_failure_
+sed: input line 2: regex '\(a*\)*\1b' of command 's' took too many steps
+EOF2
+returns_ 4 sed --regex-step-limit=10 's/\(a*\)*\1b/X/' in > out3 \
+  2> err3 || fail=1
+compare exp-err3 err3 || fail=1
+printf 'x\n' > exp3 || framework_failure_
+compare exp3 out3 || fail=1
+
+# The line number is right even if the lines before were skipped.
+seq 5000 > in7 || framework_failure_
+cat in >> in7 || framework_failure_
+sed "s/line 2:/line 5002:/;s/'s'/'p'/" exp-err3 > exp-err7 || framework_failure_
+returns_ 4 sed -n --regex-step-limit=10 '/\(a*\)*\1b/p' in7 > out7 \
+  2> err7 || fail=1
+compare exp-err7 err7 || fail=1
+
+# With --regex-overrun=no-match, the regex just does not match.
+sed --regex-step-limit=10 --regex-overrun=no-match 's/\(a*\)*\1b/X/' in \
+  > out4 || fail=1
+compare in out4 || fail=1
+
+sed -n --regex-step-limit=10 --regex-overrun=no-match '/\(a*\)*\1b/!p' in \
+  > out5 || fail=1
+compare in out5 || fail=1
+
+# A cheap regex only needs a few steps on a long line, since the DFA
+# tells where its match can start.
+printf '%010000dy\n' 0 | tr 0 x > in8 || framework_failure_
+sed -n -E --regex-step-limit=1000 '/x[xy]y/p' in8 > out8 || fail=1
+compare in8 out8 || fail=1
+sed -n -E --regex-step-limit=1000 '/x[xy]z/p' in8 > out9 || fail=1
+compare /dev/null out9 || fail=1
+
+# Invalid arguments.
+for opt in --regex-step-limit=0 --regex-step-limit=x --regex-timeout=0 \
+           --regex-timeout=-1 --regex-overrun=ignore; do
+  returns_ 4 sed $opt p in > /dev/null 2> err6 || fail=1
+  grep invalid err6 > /dev/null || fail=1
+done
+
+Exit $fail
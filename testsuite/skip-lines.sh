@@ -0,0 +1,123 @@
+#!/bin/sh
+# Test the bulk output of lines that match none of the program's addresses.
+
+# Copyright (C) 2024 Free Software Foundation, Inc.
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+. "${srcdir=.}/testsuite/init.sh"; path_prepend_ ./sed
+print_ver_ sed
+
+printf 'a\nb\nc\nd\ne\nf\n' > in1 || framework_failure_
+printf 'x\ny' > in2 || framework_failure_
+
+# Several addresses, a block and the append queue.
+printf 'a\nB\nX\nc\nappended\nd\nee\nf\n' > exp1 || framework_failure_
+sed '/b/s/b/B/;/c/{i\
+X
+a\
+appended
+};/e/{s/e/ee/}' in1 > out1 || fail=1
+compare exp1 out1 || fail=1
+
+# Line numbers after skipped lines, across files.
+printf 'a\nb\nc\n4\nd\ne\nf\nx\n8\ny' > exp2 || framework_failure_
+sed '/d/=;/y/=' in1 in2 > out2 || fail=1
+compare exp2 out2 || fail=1
+
+# The last line is modified even when it lacks a newline.
+printf 'a\nb\nc\nd\ne\nf\nx\nY' > exp3 || framework_failure_
+sed '/y/s/y/Y/' in1 in2 > out3 || fail=1
+compare exp3 out3 || fail=1
+
+# Pipes are read in blocks, too.
+cat in1 in2 | sed '/y/s/y/Y/' > out4 || fail=1
+compare exp3 out4 || fail=1
+
+# A 'q' command stops the output there.
+printf 'a\nb\nc\n' > exp5 || framework_failure_
+sed '/c/q' in1 > out5 || fail=1
+compare exp5 out5 || fail=1
+
+# With -n, only the lines that the program prints are output.
+printf 'b\n4\ne\ny\n' > exp6 || framework_failure_
+sed -n '/b/p;/d/=;/e/P;/y/{p;q}' in1 in2 > out6 || fail=1
+compare exp6 out6 || fail=1
+
+cat in1 in2 | sed -n '/b/p;/d/=;/e/P;/y/{p;q}' > out7 || fail=1
+compare exp6 out7 || fail=1
+
+printf 'c\n' > exp8 || framework_failure_
+sed -n '/[cx]/w out8' in1 > /dev/null || fail=1
+compare exp8 out8 || fail=1
+
+# Spans of lines deleted by line number.
+printf 'a\nf\nx\nY' > exp9 || framework_failure_
+sed '2,5d;/y/s/y/Y/' in1 in2 > out9 || fail=1
+compare exp9 out9 || fail=1
+
+printf 'a\nc\ne\nx\n' > exp10 || framework_failure_
+sed -n '1~2p' in1 in2 > out10 || fail=1
+compare exp10 out10 || fail=1
+
+# A regex address before 'd' still sees the lines in the span.
+printf 'a\nc\nf\nx\ny' > exp11 || framework_failure_
+sed '/c/p;2,5d' in1 in2 > out11 || fail=1
+compare exp11 out11 || fail=1
+
+# A range jumped over by a branch starts late, or not at all.
+printf 'c\nd\n' > exp12 || framework_failure_
+sed -n '1,2b;2,4p' in1 > out12 || fail=1
+compare exp12 out12 || fail=1
+sed -n '1,4b;2,3p' in1 > out13 || fail=1
+compare /dev/null out13 || fail=1
+
+# Only the last line can match '$'.
+printf 'y' > exp14 || framework_failure_
+sed -n '$p' in1 in2 > out14 || fail=1
+compare exp14 out14 || fail=1
+cat in1 in2 | sed '$!d' > out15 || fail=1
+compare exp14 out15 || fail=1
+
+printf 'f\n6\ny\n2\n' > exp16 || framework_failure_
+sed -s -n '${p;=}' in1 in2 > out16 || fail=1
+compare exp16 out16 || fail=1
+
+printf '8\n' > exp17 || framework_failure_
+sed -n '$=' in1 in2 > out17 || fail=1
+compare exp17 out17 || fail=1
+
+# The last line is found across empty and missing files.
+: > empty || framework_failure_
+printf 'a+b\nc+d\ne+f\nx+y' > exp18 || framework_failure_
+returns_ 2 sed '$!N;s/\n/+/' in1 empty missing in2 empty > out18 2> /dev/null \
+  || fail=1
+compare exp18 out18 || fail=1
+
+# The lines skipped do not update the regex that '//' stands for, so
+# nothing is skipped when the script uses it.
+printf 'a\nx\nba\n' > in19 || framework_failure_
+printf 'x\n' > exp19 || framework_failure_
+sed '3{s//X/};/a/d;/b/p' in19 > out19 || fail=1
+compare exp19 out19 || fail=1
+
+# The same script as the first, with '//' in it: the lines are not
+# skipped, and the output does not change.
+sed '/b/s//B/;/c/{i\
+X
+a\
+appended
+};/e/{s/e/ee/}' in1 > out20 || fail=1
+compare exp1 out20 || fail=1
+
+Exit $fail
@@ -0,0 +1,71 @@
+#!/bin/sh
+# Test --strict-perf, which flags regexes that may be very slow.
+
+# Copyright (C) 2024 Free Software Foundation, Inc.
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+. "${srcdir=.}/testsuite/init.sh"; path_prepend_ ./sed
+print_ver_ sed
+
+printf 'aab\n' > in || framework_failure_
+
+# Each of these regexes is rejected, with the place where it ends.
+cat <<\EOF2 > exp-err1 || framework_failure_
+sed: -e expression #1, char 13: regex has a repeated subexpression that contains a repetition, and may be very slow to match
+sed: -e expression #1, char 14: regex has a back-reference to or inside a repeated group, and may be very slow to match
+sed: -e expression #1, char 17: regex has a back-reference to or inside a repeated group, and may be very slow to match
+sed: -e expression #1, char 16: regex has bounded repetitions that expand it to more than 1024 elements, and may be very large
+sed: -e expression #1, char 11: regex has a repeated subexpression that contains a repetition, and may be very slow to match
+EOF2
+for re in '\(a*\)*b' '\(a\)*b\1' '\(\(a\)\2\)*' 'x\{1,5000\}'; do
+  returns_ 1 sed --strict-perf "s/$re/X/" in >> out1 2>> err1 || fail=1
+done
+returns_ 1 sed -E --strict-perf=error 's/(a+)+b/X/' in >> out1 2>> err1 \
+  || fail=1
+compare /dev/null out1 || fail=1
+compare exp-err1 err1 || fail=1
+
+# With --strict-perf=warn, the script still runs.
+cat <<\EOF2 > exp-err2 || framework_failure_
+sed: -e expression #1, char 13: warning: regex has a repeated subexpression that contains a repetition, and may be very slow to match
+EOF2
+printf 'X\n' > exp2 || framework_failure_
+sed --strict-perf=warn 's/\(a*\)*b/X/' in > out2 2> err2 || fail=1
+compare exp2 out2 || fail=1
+compare exp-err2 err2 || fail=1
+
+# Regexes without those constructs are accepted.
+printf 'ab\n' > exp3 || framework_failure_
+sed --strict-perf 's/\(.\)\1*/\1/g;/\(ab\)*c\|[*]*x\{2,9\}/d' in > out3 \
+  2> err3 || fail=1
+compare exp3 out3 || fail=1
+compare /dev/null err3 || fail=1
+
+# The option applies to the scripts before it as well.
+sed 's/-e expression #1, char 13: warning:/-e expression #2, char 13:/' \
+  exp-err2 > exp-err4 || framework_failure_
+returns_ 1 sed -e p -e 's/\(a*\)*b/X/' --strict-perf in > out4 2> err4 \
+  || fail=1
+compare /dev/null out4 || fail=1
+compare exp-err4 err4 || fail=1
+
+# Without it, nothing is reported.
+sed 's/\(a*\)*b/X/' in > out5 2> err5 || fail=1
+compare exp2 out5 || fail=1
+compare /dev/null err5 || fail=1
+
+returns_ 4 sed --strict-perf=maybe p in > /dev/null 2> err6 || fail=1
+grep invalid err6 > /dev/null || fail=1
+
+Exit $fail